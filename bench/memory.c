@@ -0,0 +1,73 @@
+// memory footprint of trashmap across sizes, broken down per component.
+// usage: trashmap_bench_memory
+// slots and items are allocated by the map, strings are the caller owned keys and values it points at.
+
+#define TRASHMAP_IMPL
+#include "../trashmap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef enum fill_t {
+    FILL_SET,
+    FILL_RESERVE,
+    FILL_BUILD,
+} fill_t;
+
+static const char * const fill_names[] = {"set", "reserve+set", "build"};
+
+static void report(fill_t fill, size_t n, const trashmap_t* map, size_t string_bytes) {
+    trashmap_memory_t usage = trashmap_memory_usage(map);
+    // the least a map of pointers could use, one item per entry
+    double ideal = (double)(n * sizeof(trashmap_item_t));
+    printf("%-12s %9zu %11zu %11zu %11zu %11zu %9.1f %9.1f %7.2fx\n",
+        fill_names[fill], n, usage.slots, usage.items, usage.unused_items, string_bytes,
+        (double)usage.total / (double)n, (double)(usage.total + string_bytes) / (double)n, (double)usage.total / ideal);
+}
+
+int main(void) {
+    // sizes on both sides of the item and slot doubling points
+    const size_t sizes[] = {1, 12, 13, 16, 17, 100, 384, 385, 1000, 12288, 12289, 100000, 786432, 786433, 1000000};
+    const size_t size_count = sizeof(sizes) / sizeof(sizes[0]);
+    const size_t max_n = sizes[size_count - 1];
+
+    char (*keys)[24] = (char (*)[24])malloc(max_n * sizeof(*keys));
+    trashmap_item_t* pairs = (trashmap_item_t*)malloc(max_n * sizeof(*pairs));
+    if (!keys || !pairs) return 1;
+    for (size_t i = 0; i < max_n; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key-%zu", i);
+        pairs[i].key = keys[i];
+        pairs[i].value = keys[i];
+    }
+
+    printf("%-12s %9s %11s %11s %11s %11s %9s %9s %8s\n",
+        "fill", "n", "slots", "items", "unused", "strings", "map B/e", "all B/e", "overhead");
+    for (size_t s = 0; s < size_count; s++) {
+        size_t n = sizes[s];
+        size_t string_bytes = 0;
+        for (size_t i = 0; i < n; i++) {
+            const char* c = keys[i];
+            while (*c++) string_bytes++;
+            string_bytes += 1;
+        }
+        // keys double as values so count them twice
+        string_bytes *= 2;
+
+        for (int fill = FILL_SET; fill <= FILL_BUILD; fill++) {
+            trashmap_t map;
+            trashmap_init(&map, 16);
+            if (fill == FILL_BUILD) {
+                trashmap_build(&map, pairs, n, 1);
+            } else {
+                if (fill == FILL_RESERVE) trashmap_reserve(&map, n);
+                for (size_t i = 0; i < n; i++) trashmap_set(&map, pairs[i].key, pairs[i].value);
+            }
+            report((fill_t)fill, n, &map, string_bytes);
+            trashmap_deinit(&map);
+        }
+    }
+
+    free(keys);
+    free(pairs);
+    return 0;
+}
@@ -0,0 +1,266 @@
+// differential fuzz target for trashmap_cache_t.
+// the input is a sequence of set/get/has/clear/sweep operations and clock ticks replayed against the cache and
+// against a plain array model running the same CLOCK and expiry policy, so every lookup, every eviction and
+// every pair handed to the eviction callback has to match.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef FUZZ_WEAK_HASH
+#define TRASHMAP_CUSTOM_HASH_FUNCTION
+#endif
+
+#define TRASHMAP_IMPL
+#include "../trashmap.h"
+
+#ifdef FUZZ_WEAK_HASH
+// only 8 distinct hashes, so evictions shift slots through long clusters
+trashmap_hash_t trashmap_hash(const char * key) {
+    trashmap_hash_t hash = 0;
+    while (*key) hash += (unsigned char)*key++;
+    return hash & 7;
+}
+#endif // FUZZ_WEAK_HASH
+
+#define FUZZ_CHECK(COND) do { \
+    if (!(COND)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #COND); \
+        abort(); \
+    } \
+} while (0)
+
+#define FUZZ_KEYS 256
+#define FUZZ_CAPACITY 32
+
+static char keys[FUZZ_KEYS][48];
+static char values[FUZZ_KEYS][8];
+
+static void make_keys(void) {
+    for (int i = 0; i < FUZZ_KEYS; i++) {
+        if (i % 2) snprintf(keys[i], sizeof(keys[i]), "k%d", i);
+        else snprintf(keys[i], sizeof(keys[i]), "shared-prefix-shared-prefix-%d", i);
+        snprintf(values[i], sizeof(values[i]), "v%d", i);
+    }
+}
+
+// pairs the eviction callback has to receive during the current operation, in order
+typedef struct expected_t {
+    const char * keys[FUZZ_CAPACITY];
+    const char * values[FUZZ_CAPACITY];
+    size_t count;
+    size_t next;
+} expected_t;
+
+static expected_t expected;
+
+static void expect(const char * key, const char * value) {
+    expected.keys[expected.count] = key;
+    expected.values[expected.count] = value;
+    expected.count++;
+}
+
+static void on_evict(void * ctx, const char * key, const char * value) {
+    (void)ctx;
+    FUZZ_CHECK(expected.next < expected.count);
+    FUZZ_CHECK(expected.keys[expected.next] == key && expected.values[expected.next] == value);
+    expected.next++;
+}
+
+static uint64_t now;
+
+static uint64_t fuzz_clock(void * ctx) {
+    return *(const uint64_t *)ctx;
+}
+
+// items in the same positions as the cache's arena, keys and values compared by pointer, NULL keys are free
+typedef struct model_t {
+    const char * keys[FUZZ_CAPACITY];
+    const char * values[FUZZ_CAPACITY];
+    unsigned char referenced[FUZZ_CAPACITY];
+    uint64_t expires[FUZZ_CAPACITY];
+    size_t free_items[FUZZ_CAPACITY];
+    size_t free_count;
+    size_t count;
+    size_t used;
+    size_t capacity;
+    size_t hand;
+    size_t sweep;
+    bool expiry;
+} model_t;
+
+static size_t model_find(const model_t * model, const char * key) {
+    for (size_t i = 0; i < model->used; i++) {
+        if (model->keys[i] == key) return i;
+    }
+    return SIZE_MAX;
+}
+
+static bool model_expired(const model_t * model, size_t item) {
+    return model->expiry && model->expires[item] <= now;
+}
+
+static void model_drop(model_t * model, size_t item) {
+    expect(model->keys[item], model->values[item]);
+    model->count--;
+    model->referenced[item] = 0;
+}
+
+static void model_expire(model_t * model, size_t item) {
+    model_drop(model, item);
+    model->keys[item] = NULL;
+    model->free_items[model->free_count++] = item;
+}
+
+static void model_set(model_t * model, const char * key, const char * value, uint64_t expires) {
+    size_t item = model_find(model, key);
+    if (item != SIZE_MAX) {
+        expect(model->keys[item], model->values[item]);
+        model->referenced[item] = 1;
+    } else {
+        if (model->free_count) {
+            item = model->free_items[--model->free_count];
+        } else if (model->used < model->capacity) {
+            item = model->used++;
+        } else {
+            item = model->hand;
+            while (model->referenced[item] && !model_expired(model, item)) {
+                model->referenced[item] = 0;
+                item = (item + 1) % model->used;
+            }
+            model->hand = (item + 1) % model->used;
+            model_drop(model, item);
+        }
+        model->referenced[item] = 0;
+        model->count++;
+    }
+    model->keys[item] = key;
+    model->values[item] = value;
+    model->expires[item] = expires;
+}
+
+static const char * model_get(model_t * model, const char * key) {
+    size_t item = model_find(model, key);
+    if (item == SIZE_MAX) return NULL;
+    if (model_expired(model, item)) {
+        model_expire(model, item);
+        return NULL;
+    }
+    model->referenced[item] = 1;
+    return model->values[item];
+}
+
+static bool model_has(const model_t * model, const char * key) {
+    size_t item = model_find(model, key);
+    return item != SIZE_MAX && !model_expired(model, item);
+}
+
+static size_t model_sweep(model_t * model, size_t budget) {
+    if (!model->expiry || model->used == 0) return 0;
+    size_t removed = 0;
+    for (size_t n = 0; n < budget && n < model->used; n++) {
+        size_t item = model->sweep;
+        model->sweep = (item + 1) % model->used;
+        if (model->keys[item] && model_expired(model, item)) {
+            model_expire(model, item);
+            removed++;
+        }
+    }
+    return removed;
+}
+
+static void expect_all(const model_t * model) {
+    for (size_t i = 0; i < model->used; i++) {
+        if (model->keys[i]) expect(model->keys[i], model->values[i]);
+    }
+}
+
+static void check_expected(void) {
+    FUZZ_CHECK(expected.next == expected.count);
+    expected.count = expected.next = 0;
+}
+
+static void verify(const trashmap_cache_t * cache, const model_t * model) {
+    FUZZ_CHECK(cache->map.count == model->count);
+    FUZZ_CHECK(cache->used == model->used);
+    FUZZ_CHECK(cache->free_count == model->free_count);
+    for (size_t i = 0; i < FUZZ_KEYS; i++) {
+        FUZZ_CHECK(trashmap_cache_has(cache, keys[i]) == model_has(model, keys[i]));
+    }
+    for (size_t i = 0; i < model->used; i++) {
+        FUZZ_CHECK(cache->map.items[i].key == model->keys[i]);
+        FUZZ_CHECK(cache->referenced[i] == model->referenced[i]);
+    }
+#ifdef TRASHMAP_STATS
+    trashmap_stats_t stats;
+    trashmap_stats(&cache->map, &stats);
+    FUZZ_CHECK(stats.count == model->count);
+#endif
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    static bool initialized = false;
+    if (!initialized) {
+        make_keys();
+        initialized = true;
+    }
+
+    // the first byte picks the capacity and whether items can expire
+    static model_t model;
+    model = (model_t){0};
+    model.capacity = size ? data[0] % FUZZ_CAPACITY + 1 : 1;
+    model.expiry = size && data[0] >= 128;
+    expected.count = expected.next = 0;
+    now = 0;
+    trashmap_cache_t cache;
+    trashmap_cache_init(&cache, model.capacity, on_evict, NULL);
+    if (model.expiry) trashmap_cache_set_clock(&cache, fuzz_clock, &now);
+
+    size_t pos = 1;
+    while (pos < size) {
+        uint8_t op = data[pos++];
+        uint8_t arg = pos < size ? data[pos] : 0;
+        if (op < 120) {
+            uint8_t value = pos + 1 < size ? data[pos + 1] : 0;
+            pos += 2;
+            if (model.expiry && op >= 60) {
+                // short lifetimes, a ttl of 0 has already expired
+                uint64_t ttl = value % 16;
+                model_set(&model, keys[arg], values[value], now + ttl);
+                trashmap_cache_set_ttl(&cache, keys[arg], values[value], ttl);
+            } else {
+                model_set(&model, keys[arg], values[value], UINT64_MAX);
+                trashmap_cache_set(&cache, keys[arg], values[value]);
+            }
+        } else if (op < 180) {
+            pos++;
+            const char * value = model_get(&model, keys[arg]);
+            FUZZ_CHECK(trashmap_cache_get(&cache, keys[arg]) == value);
+        } else if (op < 205) {
+            pos++;
+            FUZZ_CHECK(trashmap_cache_has(&cache, keys[arg]) == model_has(&model, keys[arg]));
+        } else if (op < 208) {
+            expect_all(&model);
+            trashmap_cache_clear(&cache);
+            model.count = model.used = model.free_count = model.hand = model.sweep = 0;
+            for (size_t i = 0; i < FUZZ_CAPACITY; i++) model.referenced[i] = 0;
+        } else if (op < 216) {
+            pos++;
+            now += arg % 8;
+        } else if (op < 224) {
+            pos++;
+            size_t removed = model_sweep(&model, arg % 8);
+            FUZZ_CHECK(trashmap_cache_sweep(&cache, arg % 8) == removed);
+        } else {
+            verify(&cache, &model);
+        }
+        check_expected();
+    }
+    verify(&cache, &model);
+    expect_all(&model);
+    trashmap_cache_deinit(&cache);
+    check_expected();
+    return 0;
+}
@@ -0,0 +1,92 @@
+// standalone driver for the fuzz targets, for compilers without libFuzzer.
+// runs every file given on the command line once, or with no files generates random inputs:
+//   fuzz_target [-runs=N] [-seed=N] [file...]
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+static uint64_t rng_state;
+
+static uint64_t rng_next(void) {
+    // splitmix64
+    uint64_t z = (rng_state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// half the inputs are mostly bytes the text targets care about, so they get past the first few checks
+static const char alphabet[] = ":\r\n \tabcXYZ-_0/";
+
+static size_t random_input(uint8_t * data, size_t capacity) {
+    size_t size = (size_t)(rng_next() % capacity);
+    bool text = rng_next() % 2;
+    for (size_t i = 0; i < size; i++) {
+        uint64_t r = rng_next();
+        data[i] = !text || r % 8 == 0 ? (uint8_t)(r >> 8) : (uint8_t)alphabet[(r >> 8) % (sizeof(alphabet) - 1)];
+    }
+    return size;
+}
+
+static int run_file(const char * path) {
+    FILE * file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "can't open %s\n", path);
+        return 1;
+    }
+    size_t capacity = 4096, size = 0, read;
+    uint8_t * data = (uint8_t *)malloc(capacity);
+    while ((read = fread(data + size, 1, capacity - size, file)) > 0) {
+        size += read;
+        if (size == capacity) {
+            capacity *= 2;
+            data = (uint8_t *)realloc(data, capacity);
+        }
+    }
+    fclose(file);
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char ** argv) {
+    size_t runs = 100000;
+    uint64_t seed = (uint64_t)time(NULL);
+    int files = 0, failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = (size_t)strtoull(argv[i] + 6, NULL, 10);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = (uint64_t)strtoull(argv[i] + 6, NULL, 10);
+        } else {
+            failed |= run_file(argv[i]);
+            files++;
+        }
+    }
+    if (files) {
+        return failed;
+    }
+
+    printf("seed %llu, %zu runs\n", (unsigned long long)seed, runs);
+    fflush(stdout);
+    rng_state = seed;
+    static uint8_t data[1024];
+    size_t bytes = 0;
+    clock_t start = clock();
+    for (size_t i = 0; i < runs; i++) {
+        size_t size = random_input(data, sizeof(data));
+        bytes += size;
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    // doubles as a throughput smoke test, a slowdown in a fast path shows up here next to the correctness checks
+    printf("done in %.2fs, %.0f runs/s, %.1f MB/s\n", seconds, seconds > 0 ? (double)runs / seconds : 0.0,
+        seconds > 0 ? (double)bytes / seconds / 1e6 : 0.0);
+    return 0;
+}
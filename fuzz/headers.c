@@ -0,0 +1,65 @@
+// fuzz target for the header parsers.
+// the input is parsed in one go with trashmap_parse_headers and again through trashmap_header_parser_t,
+// fed in chunks whose sizes come from the first input byte, and both results have to agree.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRASHMAP_IMPL
+#include "../trashmap.h"
+
+#define FUZZ_CHECK(COND) do { if (!(COND)) abort(); } while (0)
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    if (size == 0) {
+        return 0;
+    }
+    size_t chunk = data[0] % 16 + 1;
+    data++;
+    size--;
+
+    // copies sized exactly, so reading past the input trips the sanitizers
+    char * whole = (char *)malloc(size + 1);
+    char * streamed = (char *)malloc(size + 1);
+    memcpy(whole, data, size);
+    memcpy(streamed, data, size);
+
+    trashmap_t expected;
+    trashmap_init(&expected, 2);
+    size_t used = trashmap_parse_headers(&expected, whole, size);
+
+    trashmap_t map;
+    trashmap_init(&map, 2);
+    trashmap_header_parser_t parser;
+    trashmap_header_parser_init(&parser, &map);
+    trashmap_parse_result_t result = TRASHMAP_PARSE_INCOMPLETE;
+    size_t pos = 0, consumed = 0;
+    while (pos < size) {
+        size_t len = pos + chunk > size ? size - pos : chunk;
+        result = trashmap_header_parser_feed(&parser, streamed + pos, len, &consumed);
+        if (result != TRASHMAP_PARSE_INCOMPLETE) break;
+        pos += len;
+    }
+
+    if (used) {
+        FUZZ_CHECK(result == TRASHMAP_PARSE_DONE);
+        FUZZ_CHECK(pos + consumed == used);
+        FUZZ_CHECK(map.count == expected.count);
+        for (size_t i = 0; i < map.count; i++) {
+            FUZZ_CHECK(strcmp(map.items[i].key, expected.items[i].key) == 0);
+            FUZZ_CHECK(strcmp(map.items[i].value, expected.items[i].value) == 0);
+        }
+    } else {
+        FUZZ_CHECK(result != TRASHMAP_PARSE_DONE);
+    }
+
+    trashmap_header_parser_deinit(&parser);
+    trashmap_deinit(&map);
+    trashmap_deinit(&expected);
+    free(whole);
+    free(streamed);
+    return 0;
+}
@@ -0,0 +1,146 @@
+// differential fuzz target for trashmap_t.
+// the input is a sequence of set/get/has/clear/reserve/build operations replayed against the map and against
+// a plain array model, every result has to match. it is built once per compile time variant, see CMakeLists.txt.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef FUZZ_THREADS
+#include "../tests/parallel.h"
+#endif
+
+#ifdef FUZZ_WEAK_HASH
+#define TRASHMAP_CUSTOM_HASH_FUNCTION
+#endif
+
+#define TRASHMAP_IMPL
+#include "../trashmap.h"
+
+#ifdef FUZZ_WEAK_HASH
+// only 8 distinct hashes, so nearly every probe runs through long clusters and compares strings
+trashmap_hash_t trashmap_hash(const char * key) {
+    trashmap_hash_t hash = 0;
+    while (*key) hash += (unsigned char)*key++;
+    return hash & 7;
+}
+#endif // FUZZ_WEAK_HASH
+
+#define FUZZ_CHECK(COND) do { \
+    if (!(COND)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #COND); \
+        abort(); \
+    } \
+} while (0)
+
+#define FUZZ_KEYS 256
+
+// short keys, long keys and keys sharing long prefixes, plus the empty key
+static char keys[FUZZ_KEYS][80];
+static char values[FUZZ_KEYS][8];
+
+static void make_keys(void) {
+    for (int i = 0; i < FUZZ_KEYS; i++) {
+        switch (i % 3) {
+        case 0: snprintf(keys[i], sizeof(keys[i]), "k%d", i); break;
+        case 1: snprintf(keys[i], sizeof(keys[i]), "a-much-longer-key-that-spans-several-vector-widths-%d", i); break;
+        default: snprintf(keys[i], sizeof(keys[i]), "shared-prefix-shared-prefix-%d-suffix", i); break;
+        }
+        snprintf(values[i], sizeof(values[i]), "v%d", i);
+    }
+    keys[0][0] = '\0';
+}
+
+typedef struct model_t {
+    // value stored for each key, NULL when missing. values are compared by pointer
+    const char * values[FUZZ_KEYS];
+    size_t count;
+} model_t;
+
+static void model_set(model_t * model, size_t key, const char * value) {
+    if (!model->values[key]) model->count++;
+    model->values[key] = value;
+}
+
+static void verify(const trashmap_t * map, const model_t * model) {
+    FUZZ_CHECK(map->count == model->count);
+    FUZZ_CHECK(map->count <= map->capacity);
+    for (size_t i = 0; i < FUZZ_KEYS; i++) {
+        FUZZ_CHECK(trashmap_get(map, keys[i]) == model->values[i]);
+        FUZZ_CHECK(trashmap_has(map, keys[i]) == (model->values[i] != NULL));
+    }
+#ifdef TRASHMAP_STATS
+    trashmap_stats_t stats;
+    trashmap_stats(map, &stats);
+    size_t histogram = 0;
+    for (size_t i = 0; i < TRASHMAP_PROBE_HISTOGRAM_SIZE; i++) histogram += stats.probe_histogram[i];
+    FUZZ_CHECK(stats.count == model->count && histogram == model->count);
+#endif
+#ifdef TRASHMAP_COUNTERS
+    FUZZ_CHECK(map->counters.gets == map->counters.hits + map->counters.misses);
+    FUZZ_CHECK(map->counters.overwrites <= map->counters.sets);
+#endif
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size);
+
+int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    static bool initialized = false;
+    if (!initialized) {
+        make_keys();
+        initialized = true;
+    }
+
+    model_t model = {{NULL}, 0};
+    trashmap_t map;
+    trashmap_init(&map, size ? data[0] % 64 + 1 : 1);
+    trashmap_item_t pairs[FUZZ_KEYS];
+
+    size_t pos = 1;
+    while (pos < size) {
+        uint8_t op = data[pos++];
+        uint8_t arg = pos < size ? data[pos] : 0;
+        if (op < 120) {
+            uint8_t value = pos + 1 < size ? data[pos + 1] : 0;
+            pos += 2;
+            trashmap_set(&map, keys[arg], values[value]);
+            model_set(&model, arg, values[value]);
+        } else if (op < 170) {
+            pos++;
+            FUZZ_CHECK(trashmap_get(&map, keys[arg]) == model.values[arg]);
+        } else if (op < 200) {
+            pos++;
+            FUZZ_CHECK(trashmap_has(&map, keys[arg]) == (model.values[arg] != NULL));
+        } else if (op < 204) {
+            trashmap_clear(&map);
+            model = (model_t){{NULL}, 0};
+        } else if (op < 214) {
+            pos++;
+            trashmap_reserve(&map, (size_t)arg * 8);
+            FUZZ_CHECK(map.capacity >= map.count + (size_t)arg * 8);
+        } else if (op < 224) {
+            // build replaces the contents, later duplicates win
+            pos++;
+            size_t count = 0;
+            model = (model_t){{NULL}, 0};
+            for (; count < arg && pos + 1 < size; count++, pos += 2) {
+                pairs[count].key = keys[data[pos]];
+                pairs[count].value = values[data[pos + 1]];
+                model_set(&model, data[pos], values[data[pos + 1]]);
+            }
+            trashmap_build(&map, pairs, count, arg % 5);
+        } else if (op < 228) {
+            trashmap_shrink_to_fit(&map);
+            FUZZ_CHECK(map.capacity == map.count && map.count <= map.slot_count * 3 / 4);
+        } else if (op < 232) {
+            pos++;
+            trashmap_clear_shrink(&map, (size_t)arg % 64 + 1);
+            model = (model_t){{NULL}, 0};
+        } else {
+            verify(&map, &model);
+        }
+    }
+    verify(&map, &model);
+    trashmap_deinit(&map);
+    return 0;
+}
@@ -14,5 +14,7 @@ int main() {
 
     printf("hello %s\n", world);
 
+    trashmap_deinit(&map);
+
     return 0;
 }
\ No newline at end of file
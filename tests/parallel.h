@@ -0,0 +1,40 @@
+// a pthread TRASHMAP_PARALLEL_FOR for the tests and fuzz targets, include before trashmap.h.
+// tasks run on 4 threads and rehashing goes parallel from 8 slots, so the parallel code paths really race.
+
+#ifndef TRASHMAP_TEST_PARALLEL_H
+#define TRASHMAP_TEST_PARALLEL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+typedef struct test_job_t {
+    void (*task)(void *, size_t);
+    void * ctx;
+    size_t first, count, step;
+} test_job_t;
+
+static void * test_run_job(void * arg) {
+    test_job_t * job = (test_job_t *)arg;
+    for (size_t i = job->first; i < job->count; i += job->step) job->task(job->ctx, i);
+    return NULL;
+}
+
+static void test_parallel_for(void (*task)(void *, size_t), void * ctx, size_t count) {
+    pthread_t threads[4];
+    test_job_t jobs[4];
+    for (size_t i = 0; i < 4; i++) {
+        jobs[i].task = task;
+        jobs[i].ctx = ctx;
+        jobs[i].first = i;
+        jobs[i].count = count;
+        jobs[i].step = 4;
+        pthread_create(&threads[i], NULL, test_run_job, &jobs[i]);
+    }
+    for (size_t i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+}
+
+#define TRASHMAP_PARALLEL_FOR(TASK, CTX, COUNT) test_parallel_for((TASK), (CTX), (COUNT))
+#define TRASHMAP_PARALLEL_REHASH_MIN 8
+#define TRASHMAP_PARALLEL_REHASH_TASKS 7
+
+#endif // TRASHMAP_TEST_PARALLEL_H
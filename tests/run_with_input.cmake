@@ -0,0 +1,17 @@
+# runs PROGRAM with INPUT on stdin and checks that it exits cleanly and prints EXPECTED.
+# cmake -DPROGRAM=... -DINPUT=... -DEXPECTED=... -P run_with_input.cmake
+
+execute_process(
+    COMMAND ${PROGRAM}
+    INPUT_FILE ${INPUT}
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result
+    TIMEOUT 10
+)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${PROGRAM} failed: ${result}\n${output}")
+endif()
+string(FIND "${output}" "${EXPECTED}" found)
+if(found EQUAL -1)
+    message(FATAL_ERROR "expected \"${EXPECTED}\" in output:\n${output}")
+endif()
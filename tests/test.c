@@ -15,15 +15,19 @@ int main()
     trashmap_t map;
     trashmap_init(&map, 4);
     char cmd[512], key[512], value[512];
-    while (1) {
-        int r = fscanf(stdin, "%s %s", cmd, key);
-        (void)r;
+    while (fscanf(stdin, "%511s %511s", cmd, key) == 2) {
         if (trashmap_strcmp(cmd, "get") == 0) {
             printf("map[\"%s\"] => \"%s\"\n", key, trashmap_get(&map, key));
         } else if (trashmap_strcmp(cmd, "set") == 0) {
-            r = fscanf(stdin, "%s", value);
-            (void)r;
-            trashmap_set(&map, my_strdup(key), my_strdup(value));
+            if (fscanf(stdin, "%511s", value) != 1) break;
+            // the map keeps the first copy of a key, only the value is replaced
+            const char * old = trashmap_get(&map, key);
+            if (old) {
+                free((char*)old);
+                trashmap_set(&map, key, my_strdup(value));
+            } else {
+                trashmap_set(&map, my_strdup(key), my_strdup(value));
+            }
             printf("map[\"%s\"] <= \"%s\"\n", key, value);
         } else if (trashmap_strcmp(cmd, "has") == 0) {
             if (trashmap_has(&map, key)) {
@@ -38,5 +42,10 @@ int main()
             printf("unrecognised command. try 'get', 'set', 'has', or 'hash'\n");
         }
     }
+    for (size_t i = 0; i < map.count; i++) {
+        free((char*)map.items[i].key);
+        free((char*)map.items[i].value);
+    }
+    trashmap_deinit(&map);
     return 0;
 }
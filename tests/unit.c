@@ -0,0 +1,896 @@
+// unit tests, built as C99 and C++20 and once per feature configuration, see CMakeLists.txt
+
+#ifdef TRASHMAP_MMAP
+// MAP_ANONYMOUS for the guard page test
+#define _DEFAULT_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TRASHMAP_TEST_THREADS
+#include "parallel.h"
+#endif
+
+#ifdef TRASHMAP_TEST_ALLOC
+// an alternate allocator without TRASHMAP_CALLOC, which hands out dirty memory, so every slot array
+// has to be zeroed by the fallback
+static size_t test_allocations = 0;
+
+static void * test_alloc(size_t size) {
+    test_allocations++;
+    unsigned char * ptr = (unsigned char *)malloc(size);
+    for (size_t i = 0; ptr && i < size; i++) ptr[i] = 0xAB;
+    return ptr;
+}
+
+#define TRASHMAP_ALLOC(SIZE) test_alloc(SIZE)
+#define TRASHMAP_REALLOC(PTR, SIZE) realloc(PTR, SIZE)
+#define TRASHMAP_FREE(PTR) free(PTR)
+#endif // TRASHMAP_TEST_ALLOC
+
+#define TRASHMAP_IMPL
+#include "../trashmap.h"
+
+static int failures = 0;
+
+#define CHECK(COND) do { \
+    if (!(COND)) { \
+        fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #COND); \
+        failures++; \
+    } \
+} while (0)
+
+#define CHECK_STR(ACTUAL, EXPECTED) CHECK((ACTUAL) && strcmp((ACTUAL), (EXPECTED)) == 0)
+
+#define KEY_COUNT 5000
+static char keys[KEY_COUNT][24];
+static char values[KEY_COUNT][24];
+
+static void make_keys(void) {
+    for (int i = 0; i < KEY_COUNT; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key%d", i);
+        snprintf(values[i], sizeof(values[i]), "value%d", i);
+    }
+}
+
+static char * copy_string(const char * str) {
+    char * copy = (char *)malloc(strlen(str) + 1);
+    return strcpy(copy, str);
+}
+
+static void test_streq(void) {
+    // every length, misalignment and mismatch position across a couple of vector widths
+    static char lhs[256], rhs[256];
+    for (size_t offset = 0; offset < 33; offset++) {
+        for (size_t len = 0; len < 100; len++) {
+            char * l = lhs + offset;
+            char * r = rhs + (offset * 7) % 33;
+            for (size_t i = 0; i < len; i++) l[i] = r[i] = (char)('a' + i % 26);
+            l[len] = r[len] = '\0';
+            CHECK(trashmap_streq(l, r));
+            CHECK(trashmap_memeq(l, r, len));
+            for (size_t i = 0; i < len; i++) {
+                r[i] = 'A';
+                CHECK(!trashmap_streq(l, r));
+                CHECK(!trashmap_memeq(l, r, len));
+                CHECK(trashmap_memeq(l, r, i));
+                r[i] = l[i];
+            }
+            // one string a prefix of the other
+            if (len > 0) {
+                r[len - 1] = '\0';
+                CHECK(!trashmap_streq(l, r));
+                CHECK(!trashmap_streq(r, l));
+                r[len - 1] = l[len - 1];
+            }
+        }
+    }
+}
+
+#ifdef TRASHMAP_MMAP
+// strings ending right before an unmapped page, a load crossing into it would crash
+static void test_streq_page_boundary(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    char * pages = (char *)mmap(NULL, 3 * (size_t)page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(pages != MAP_FAILED);
+    if (pages == MAP_FAILED) return;
+    CHECK(mprotect(pages + page, (size_t)page, PROT_NONE) == 0);
+    char * lhs_end = pages + page;
+    char * rhs_end = pages + 3 * page;
+    CHECK(mprotect(rhs_end - page, (size_t)page, PROT_READ | PROT_WRITE) == 0);
+    for (size_t len = 0; len < 100; len++) {
+        char * l = lhs_end - len - 1;
+        char * r = pages + 2 * page + 100 - len % 17;
+        for (size_t i = 0; i < len; i++) l[i] = r[i] = (char)('a' + i % 26);
+        l[len] = r[len] = '\0';
+        CHECK(trashmap_streq(l, r));
+        CHECK(trashmap_streq(r, l));
+        if (len > 0) {
+            r[len / 2] = '#';
+            CHECK(!trashmap_streq(l, r));
+            CHECK(!trashmap_streq(r, l));
+        }
+    }
+    munmap(pages, 3 * (size_t)page);
+}
+#endif // TRASHMAP_MMAP
+
+static void test_hash(void) {
+    // published FNV-1a test vectors
+#ifdef TRASHMAP_64BIT
+    CHECK(trashmap_hash("") == 0xcbf29ce484222325ull);
+    CHECK(trashmap_hash("a") == 0xaf63dc4c8601ec8cull);
+    CHECK(trashmap_hash("foobar") == 0x85944171f73967e8ull);
+    CHECK(sizeof(trashmap_index_t) == 8);
+#else
+    CHECK(trashmap_hash("") == 0x811c9dc5u);
+    CHECK(trashmap_hash("a") == 0xe40c292cu);
+    CHECK(trashmap_hash("foobar") == 0xbf9cf968u);
+#endif // TRASHMAP_64BIT
+}
+
+static void test_basic(void) {
+    trashmap_t map;
+    trashmap_init(&map, 1);
+    CHECK(!trashmap_has(&map, "hello"));
+    CHECK(trashmap_get(&map, "hello") == NULL);
+    trashmap_set(&map, "hello", "world");
+    CHECK(trashmap_has(&map, "hello"));
+    CHECK_STR(trashmap_get(&map, "hello"), "world");
+    trashmap_set(&map, "hello", "there");
+    CHECK_STR(trashmap_get(&map, "hello"), "there");
+    CHECK(map.count == 1);
+    trashmap_set(&map, "", "empty key");
+    CHECK_STR(trashmap_get(&map, ""), "empty key");
+    trashmap_clear(&map);
+    CHECK(map.count == 0);
+    CHECK(!trashmap_has(&map, "hello"));
+    trashmap_set(&map, "hello", "again");
+    CHECK_STR(trashmap_get(&map, "hello"), "again");
+    trashmap_deinit(&map);
+}
+
+static void test_growth(void) {
+    trashmap_t map;
+    trashmap_init(&map, 3);
+    for (int i = 0; i < KEY_COUNT; i++) trashmap_set(&map, keys[i], values[i]);
+    CHECK(map.count == KEY_COUNT);
+    CHECK(map.count <= map.slot_count * 3 / 4);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(trashmap_get(&map, keys[i]) == values[i]);
+    CHECK(!trashmap_has(&map, "key-missing"));
+
+    // a large reserve grows straight to a big enough table
+    trashmap_reserve(&map, 10 * KEY_COUNT);
+    CHECK(map.capacity >= 11 * KEY_COUNT);
+    CHECK(map.slot_count * 3 / 4 >= 11 * KEY_COUNT);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(trashmap_get(&map, keys[i]) == values[i]);
+
+    trashmap_memory_t usage = trashmap_memory_usage(&map);
+    CHECK(usage.slots == map.slot_count * sizeof(trashmap_slot_t));
+    CHECK(usage.items == map.capacity * sizeof(trashmap_item_t));
+    CHECK(usage.unused_items == (map.capacity - map.count) * sizeof(trashmap_item_t));
+#ifdef TRASHMAP_FILTER
+    CHECK(usage.filter == (map.filter_blocks + 1) * sizeof(trashmap_filter_block_t));
+#else
+    CHECK(usage.filter == 0);
+#endif // TRASHMAP_FILTER
+    CHECK(usage.total == usage.slots + usage.items + usage.filter);
+    trashmap_deinit(&map);
+}
+
+static void test_shrink(void) {
+    trashmap_t map;
+    trashmap_init(&map, 4);
+    for (int i = 0; i < KEY_COUNT; i++) trashmap_set(&map, keys[i], values[i]);
+    size_t peak = trashmap_memory_usage(&map).total;
+
+    // clearing below the watermark keeps everything
+    trashmap_clear_shrink(&map, map.slot_count);
+    CHECK(trashmap_memory_usage(&map).total == peak);
+
+    // shrinking keeps every item and halves down to the smallest table within the load limit
+    for (int i = 0; i < 100; i++) trashmap_set(&map, keys[i], values[i]);
+    trashmap_shrink_to_fit(&map);
+    CHECK(map.capacity == 100);
+    CHECK(map.slot_count == 256);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(trashmap_get(&map, keys[i]) == (i < 100 ? values[i] : NULL));
+    trashmap_set(&map, keys[100], values[100]);
+    CHECK(trashmap_get(&map, keys[100]) == values[100] && map.count == 101);
+
+    trashmap_clear(&map);
+    trashmap_shrink_to_fit(&map);
+    CHECK(map.capacity == 0 && map.items == NULL && map.slot_count == 1);
+    CHECK(!trashmap_has(&map, keys[0]));
+
+    // an outlier is released by the next clear over the watermark
+    for (int i = 0; i < KEY_COUNT; i++) trashmap_set(&map, keys[i], values[i]);
+    trashmap_clear_shrink(&map, 64);
+    CHECK(map.count == 0 && map.slot_count == 64 && map.capacity == 48);
+    CHECK(trashmap_memory_usage(&map).total < peak / 50);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(!trashmap_has(&map, keys[i]));
+    for (int i = 0; i < 48; i++) trashmap_set(&map, keys[i], values[i]);
+    CHECK(map.slot_count == 64 && map.capacity == 48);
+    for (int i = 0; i < 48; i++) CHECK(trashmap_get(&map, keys[i]) == values[i]);
+    trashmap_deinit(&map);
+}
+
+static void test_key_lengths(void) {
+    // keys around the slot prefix size sharing prefixes, and two huge keys differing only in their last byte
+    static char short_keys[12][16];
+    size_t huge_len = 70000;
+    char * huge_a = (char *)malloc(huge_len + 1);
+    char * huge_b = (char *)malloc(huge_len + 1);
+    memset(huge_a, 'h', huge_len);
+    memset(huge_b, 'h', huge_len);
+    huge_a[huge_len] = huge_b[huge_len] = '\0';
+    huge_b[huge_len - 1] = 'i';
+
+    trashmap_t map;
+    trashmap_init(&map, 1);
+    for (int i = 0; i < 12; i++) {
+        memset(short_keys[i], 'k', (size_t)i);
+        short_keys[i][i] = '\0';
+        trashmap_set(&map, short_keys[i], values[i]);
+    }
+    trashmap_set(&map, huge_a, "a");
+    CHECK(!trashmap_has(&map, huge_b));
+    trashmap_set(&map, huge_b, "b");
+    for (int i = 0; i < 12; i++) CHECK(trashmap_get(&map, short_keys[i]) == values[i]);
+    CHECK(!trashmap_has(&map, "kkkkkkkkkkkkk"));
+    CHECK(!trashmap_has(&map, "kkkkkx"));
+    CHECK(!trashmap_has(&map, "kkkkkkx"));
+    CHECK_STR(trashmap_get(&map, huge_a), "a");
+    CHECK_STR(trashmap_get(&map, huge_b), "b");
+    CHECK(map.count == 14);
+    trashmap_deinit(&map);
+    free(huge_a);
+    free(huge_b);
+}
+
+static void test_build(void) {
+    static trashmap_item_t pairs[2 * KEY_COUNT];
+    // every key twice, the second copy should win
+    for (int i = 0; i < KEY_COUNT; i++) {
+        pairs[i].key = keys[i];
+        pairs[i].value = keys[i];
+        pairs[KEY_COUNT + i].key = keys[(i * 7) % KEY_COUNT];
+        pairs[KEY_COUNT + i].value = values[(i * 7) % KEY_COUNT];
+    }
+    for (size_t threads = 0; threads < 10; threads += 3) {
+        trashmap_t map;
+        trashmap_init(&map, 2);
+        trashmap_set(&map, "stale", "value");
+        trashmap_build(&map, pairs, 2 * KEY_COUNT, threads);
+        CHECK(map.count == KEY_COUNT);
+        CHECK(!trashmap_has(&map, "stale"));
+        for (int i = 0; i < KEY_COUNT; i++) CHECK(trashmap_get(&map, keys[i]) == values[i]);
+        for (size_t i = 0; i < map.count; i++) CHECK(trashmap_get(&map, map.items[i].key) == map.items[i].value);
+        trashmap_set(&map, "after", "build");
+        CHECK_STR(trashmap_get(&map, "after"), "build");
+        trashmap_build(&map, pairs, 0, threads);
+        CHECK(map.count == 0);
+        trashmap_deinit(&map);
+    }
+}
+
+static void test_merge(void) {
+    // defaults hold keys [0, 100), route [50, 150) with other values
+    trashmap_t defaults, route, merged;
+    trashmap_init(&defaults, 4);
+    trashmap_init(&route, 4);
+    for (int i = 0; i < 100; i++) trashmap_set(&defaults, keys[i], values[i]);
+    for (int i = 50; i < 150; i++) trashmap_set(&route, keys[i], values[i + 1000]);
+
+    trashmap_init(&merged, 1);
+    trashmap_merge(&merged, &defaults, TRASHMAP_MERGE_KEEP);
+    trashmap_merge(&merged, &route, TRASHMAP_MERGE_KEEP);
+    CHECK(merged.count == 150);
+    for (int i = 0; i < 150; i++) CHECK(trashmap_get(&merged, keys[i]) == values[i < 100 ? i : i + 1000]);
+    // new keys are appended in the order they were inserted into their source
+    bool ordered = true;
+    for (int i = 0; i < 150; i++) ordered &= merged.items[i].key == keys[i];
+    CHECK(ordered);
+
+#ifdef TRASHMAP_COUNTERS
+    size_t resizes = merged.counters.resizes;
+#endif // TRASHMAP_COUNTERS
+    trashmap_merge(&merged, &route, TRASHMAP_MERGE_OVERWRITE);
+    CHECK(merged.count == 150);
+    for (int i = 0; i < 150; i++) CHECK(trashmap_get(&merged, keys[i]) == values[i < 50 ? i : i + 1000]);
+    CHECK(!trashmap_has(&merged, keys[150]));
+#ifdef TRASHMAP_COUNTERS
+    // one reserve up front at most
+    CHECK(merged.counters.resizes <= resizes + 1);
+#endif // TRASHMAP_COUNTERS
+
+    // merging into itself changes nothing
+    trashmap_merge(&merged, &merged, TRASHMAP_MERGE_OVERWRITE);
+    CHECK(merged.count == 150);
+
+    // request over route over defaults, without copying
+    trashmap_t request;
+    trashmap_init(&request, 4);
+    trashmap_set(&request, keys[0], values[2000]);
+    trashmap_set(&request, keys[60], values[2060]);
+    trashmap_set(&request, keys[200], values[2200]);
+    const trashmap_t* layers[] = {&request, &route, &defaults};
+    trashmap_overlay_t overlay;
+    trashmap_overlay_init(&overlay, layers, 3);
+    CHECK(trashmap_overlay_get(&overlay, keys[0]) == values[2000]);
+    CHECK(trashmap_overlay_get(&overlay, keys[1]) == values[1]);
+    CHECK(trashmap_overlay_get(&overlay, keys[60]) == values[2060]);
+    CHECK(trashmap_overlay_get(&overlay, keys[70]) == values[1070]);
+    CHECK(trashmap_overlay_get(&overlay, keys[120]) == values[1120]);
+    CHECK(trashmap_overlay_get(&overlay, keys[200]) == values[2200]);
+    CHECK(trashmap_overlay_get(&overlay, keys[300]) == NULL);
+    CHECK(trashmap_overlay_has(&overlay, keys[149]));
+    CHECK(!trashmap_overlay_has(&overlay, keys[150]));
+
+    // later changes to a layer are visible through the overlay
+    trashmap_set(&defaults, keys[300], values[300]);
+    CHECK(trashmap_overlay_get(&overlay, keys[300]) == values[300]);
+    trashmap_overlay_init(&overlay, layers, 0);
+    CHECK(!trashmap_overlay_has(&overlay, keys[0]));
+
+    trashmap_deinit(&request);
+    trashmap_deinit(&merged);
+    trashmap_deinit(&route);
+    trashmap_deinit(&defaults);
+}
+
+static void test_concurrent(void) {
+    trashmap_concurrent_t map;
+    trashmap_concurrent_init(&map, 100);
+    for (int i = 0; i < 100; i++) CHECK(trashmap_concurrent_set(&map, keys[i], values[i]));
+    CHECK(trashmap_concurrent_set(&map, keys[0], "updated"));
+    // the update claimed no item, a new key does not fit
+    CHECK(!trashmap_concurrent_set(&map, keys[100], values[100]));
+    CHECK_STR(trashmap_concurrent_get(&map, keys[0]), "updated");
+    for (int i = 1; i < 100; i++) CHECK(trashmap_concurrent_get(&map, keys[i]) == values[i]);
+    CHECK(trashmap_concurrent_has(&map, keys[99]));
+    CHECK(!trashmap_concurrent_has(&map, keys[100]));
+    trashmap_concurrent_deinit(&map);
+}
+
+static void test_sharded(void) {
+    trashmap_sharded_t map;
+    trashmap_sharded_init(&map, 8, 4);
+    for (int i = 0; i < KEY_COUNT; i++) trashmap_sharded_set(&map, keys[i], values[i]);
+    size_t total = 0;
+    for (size_t s = 0; s < map.shard_count; s++) {
+        total += map.shards[s].map.count;
+        // keys are spread over the shards
+        CHECK(map.shards[s].map.count > 0);
+    }
+    CHECK(total == KEY_COUNT);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(trashmap_sharded_get(&map, keys[i]) == values[i]);
+    CHECK(!trashmap_sharded_has(&map, "key-missing"));
+#ifdef TRASHMAP_COMPACT_SLOTS
+    // the shard must not fix the top bits of the 16 bit slot fingerprints, 3 bits for 8 shards
+    for (size_t s = 0; s < map.shard_count; s++) {
+        const trashmap_t* shard = &map.shards[s].map;
+        unsigned seen = 0;
+        for (size_t idx = 0; idx < shard->slot_count; idx++) {
+            if (shard->slots[idx].index != 0) seen |= 1u << (shard->slots[idx].hash >> 13);
+        }
+        CHECK(seen == 0xffu);
+    }
+#endif // TRASHMAP_COMPACT_SLOTS
+    trashmap_sharded_deinit(&map);
+
+    trashmap_sharded_init(&map, 1, 4);
+    trashmap_sharded_set(&map, "a", "b");
+    CHECK_STR(trashmap_sharded_get(&map, "a"), "b");
+    trashmap_sharded_deinit(&map);
+}
+
+typedef struct evictions_t {
+    size_t count;
+    const char * last_key;
+    const char * last_value;
+} evictions_t;
+
+static void count_eviction(void * ctx, const char * key, const char * value) {
+    evictions_t * evictions = (evictions_t *)ctx;
+    evictions->count += 1;
+    evictions->last_key = key;
+    evictions->last_value = value;
+}
+
+static void test_cache(void) {
+    evictions_t evictions = {0, NULL, NULL};
+    trashmap_cache_t cache;
+    trashmap_cache_init(&cache, 100, count_eviction, &evictions);
+    for (int i = 0; i < 100; i++) trashmap_cache_set(&cache, keys[i], values[i]);
+    CHECK(evictions.count == 0);
+    // the first half is read, so CLOCK passes over it and evicts the second half
+    for (int i = 0; i < 50; i++) CHECK(trashmap_cache_get(&cache, keys[i]) == values[i]);
+    for (int i = 100; i < 150; i++) trashmap_cache_set(&cache, keys[i], values[i]);
+    CHECK(evictions.count == 50);
+    CHECK(cache.evictions == 50);
+    CHECK(cache.map.count == 100);
+    for (int i = 0; i < 50; i++) CHECK(trashmap_cache_has(&cache, keys[i]));
+    for (int i = 50; i < 100; i++) CHECK(!trashmap_cache_has(&cache, keys[i]));
+    for (int i = 100; i < 150; i++) CHECK(trashmap_cache_get(&cache, keys[i]) == values[i]);
+
+    // replacing a value hands back the old pair
+    trashmap_cache_set(&cache, keys[0], "replaced");
+    CHECK(evictions.count == 51 && evictions.last_key == keys[0] && evictions.last_value == values[0]);
+    CHECK_STR(trashmap_cache_get(&cache, keys[0]), "replaced");
+
+    // heavy churn keeps every present key reachable through backward shift deletion
+    for (int i = 0; i < KEY_COUNT; i++) {
+        trashmap_cache_set(&cache, keys[i], values[i]);
+        if (i % 3 == 0) CHECK(trashmap_cache_get(&cache, keys[i / 2]) == (trashmap_cache_has(&cache, keys[i / 2]) ? values[i / 2] : NULL));
+    }
+    size_t present = 0;
+    for (int i = 0; i < KEY_COUNT; i++) present += trashmap_cache_has(&cache, keys[i]);
+    CHECK(present == 100);
+    for (size_t i = 0; i < cache.map.count; i++) CHECK(trashmap_cache_get(&cache, cache.map.items[i].key) == cache.map.items[i].value);
+
+    trashmap_cache_clear(&cache);
+    CHECK(cache.map.count == 0);
+    CHECK(!trashmap_cache_has(&cache, keys[0]));
+    trashmap_cache_set(&cache, "a", "b");
+    size_t before = evictions.count;
+    trashmap_cache_deinit(&cache);
+    CHECK(evictions.count == before + 1);
+}
+
+static uint64_t read_test_clock(void * ctx) {
+    return *(const uint64_t *)ctx;
+}
+
+static void test_cache_ttl(void) {
+    evictions_t evictions = {0, NULL, NULL};
+    uint64_t now = 0;
+    trashmap_cache_t cache;
+    trashmap_cache_init(&cache, 10, count_eviction, &evictions);
+    trashmap_cache_set_clock(&cache, read_test_clock, &now);
+    for (int i = 0; i < 5; i++) trashmap_cache_set_ttl(&cache, keys[i], values[i], 10);
+    for (int i = 5; i < 10; i++) trashmap_cache_set(&cache, keys[i], values[i]);
+    now = 9;
+    for (int i = 0; i < 10; i++) CHECK(trashmap_cache_has(&cache, keys[i]));
+
+    // expired items read as missing, a get removes them
+    now = 10;
+    CHECK(trashmap_cache_get(&cache, keys[0]) == NULL);
+    CHECK(evictions.count == 1 && evictions.last_key == keys[0]);
+    CHECK(!trashmap_cache_has(&cache, keys[1]));
+    CHECK(cache.map.count == 9);
+
+    // the sweep removes the rest within its budget, and their places are reused without evicting
+    CHECK(trashmap_cache_sweep(&cache, 3) == 2);
+    CHECK(trashmap_cache_sweep(&cache, 100) == 2);
+    CHECK(cache.map.count == 5 && cache.expirations == 5 && cache.free_count == 5);
+    for (int i = 10; i < 15; i++) trashmap_cache_set(&cache, keys[i], values[i]);
+    CHECK(cache.used == 10 && cache.evictions == 0);
+    for (int i = 5; i < 15; i++) CHECK(trashmap_cache_get(&cache, keys[i]) == values[i]);
+
+    // a plain set clears the deadline, and a full cache evicts an expired item even if it was read
+    trashmap_cache_set_ttl(&cache, keys[5], values[5], 1);
+    trashmap_cache_set(&cache, keys[6], values[6]);
+    trashmap_cache_set_ttl(&cache, keys[7], values[7], 1);
+    trashmap_cache_set(&cache, keys[7], values[7]);
+    now = 100;
+    CHECK(!trashmap_cache_has(&cache, keys[5]));
+    CHECK(trashmap_cache_has(&cache, keys[7]));
+    trashmap_cache_set(&cache, keys[20], values[20]);
+    CHECK(cache.evictions == 1);
+    CHECK(!trashmap_cache_has(&cache, keys[5]));
+    for (int i = 6; i < 15; i++) CHECK(trashmap_cache_has(&cache, keys[i]));
+    CHECK(trashmap_cache_get(&cache, keys[20]) == values[20]);
+
+    size_t before = evictions.count;
+    trashmap_cache_deinit(&cache);
+    CHECK(evictions.count == before + 10);
+}
+
+static void test_pool(void) {
+    trashmap_pool_t pool;
+    trashmap_pool_init(&pool, 8, 64, 2);
+    trashmap_t a, b, c;
+    trashmap_pool_acquire(&pool, &a);
+    CHECK(a.slot_count == 8 && a.count == 0);
+    trashmap_set(&a, keys[0], values[0]);
+    trashmap_slot_t* a_slots = a.slots;
+    trashmap_pool_release(&pool, &a);
+    CHECK(pool.idle_count == 1);
+
+    // reused maps come back empty
+    trashmap_pool_acquire(&pool, &b);
+    CHECK(b.slots == a_slots && b.count == 0);
+    CHECK(!trashmap_has(&b, keys[0]));
+#ifdef TRASHMAP_COUNTERS
+    CHECK(b.counters.sets == 0 && b.counters.gets == 1);
+#endif // TRASHMAP_COUNTERS
+
+    // an outlier is shrunk back to the watermark on release
+    for (int i = 0; i < 1000; i++) trashmap_set(&b, keys[i], values[i]);
+    CHECK(b.slot_count > 64);
+    trashmap_pool_release(&pool, &b);
+    trashmap_pool_acquire(&pool, &c);
+    CHECK(c.slot_count == 64 && c.capacity <= 48 && c.count == 0);
+    for (int i = 0; i < 1000; i++) CHECK(!trashmap_has(&c, keys[i]));
+    trashmap_set(&c, keys[1], values[1]);
+    CHECK(trashmap_get(&c, keys[1]) == values[1]);
+
+    // only `max_idle` maps are kept
+    trashmap_pool_acquire(&pool, &a);
+    trashmap_pool_acquire(&pool, &b);
+    trashmap_pool_release(&pool, &a);
+    trashmap_pool_release(&pool, &b);
+    trashmap_pool_release(&pool, &c);
+    CHECK(pool.idle_count == 2);
+    trashmap_pool_trim(&pool, 1);
+    CHECK(pool.idle_count == 1);
+    trashmap_pool_deinit(&pool);
+    CHECK(pool.idle_count == 0 && pool.idle == NULL);
+}
+
+#ifdef TRASHMAP_TEST_THREADS
+static trashmap_concurrent_t shared_concurrent;
+static trashmap_sharded_t shared_sharded;
+
+static void * test_thread_worker(void * arg) {
+    size_t thread = (size_t)arg;
+    // threads overlap on half of their keys
+    for (size_t i = thread * KEY_COUNT / 8; i < thread * KEY_COUNT / 8 + KEY_COUNT / 4 && i < KEY_COUNT; i++) {
+        trashmap_concurrent_set(&shared_concurrent, keys[i], values[i]);
+        trashmap_sharded_set(&shared_sharded, keys[i], values[i]);
+        if (trashmap_concurrent_get(&shared_concurrent, keys[i]) != values[i]) return (void *)1;
+        if (trashmap_sharded_get(&shared_sharded, keys[i]) != values[i]) return (void *)1;
+    }
+    return NULL;
+}
+
+static void test_threads(void) {
+    trashmap_concurrent_init(&shared_concurrent, 2 * KEY_COUNT);
+    trashmap_sharded_init(&shared_sharded, 4, 4);
+    pthread_t threads[8];
+    for (size_t i = 0; i < 8; i++) pthread_create(&threads[i], NULL, test_thread_worker, (void *)i);
+    for (size_t i = 0; i < 8; i++) {
+        void * result;
+        pthread_join(threads[i], &result);
+        CHECK(result == NULL);
+    }
+    size_t end = 7 * KEY_COUNT / 8 + KEY_COUNT / 4;
+    for (size_t i = 0; i < end && i < KEY_COUNT; i++) {
+        CHECK(trashmap_concurrent_get(&shared_concurrent, keys[i]) == values[i]);
+        CHECK(trashmap_sharded_get(&shared_sharded, keys[i]) == values[i]);
+    }
+    trashmap_concurrent_deinit(&shared_concurrent);
+    trashmap_sharded_deinit(&shared_sharded);
+}
+#endif // TRASHMAP_TEST_THREADS
+
+static void test_image(void) {
+    trashmap_reloc_t map;
+    trashmap_reloc_init(&map, 1);
+    for (int i = 0; i < KEY_COUNT; i++) trashmap_reloc_set(&map, keys[i], values[i]);
+    trashmap_reloc_set(&map, keys[5], "updated");
+    CHECK(map.image->count == KEY_COUNT);
+
+    trashmap_reloc_t clone;
+    trashmap_reloc_clone(&clone, &map);
+    // the image is position independent, a plain copy elsewhere can be read
+    void * moved = malloc(map.size);
+    memcpy(moved, map.image, map.size);
+    trashmap_reloc_deinit(&map);
+    for (int i = 0; i < KEY_COUNT; i++) {
+        const char * expected = i == 5 ? "updated" : values[i];
+        CHECK_STR(trashmap_image_get((const trashmap_image_t *)moved, keys[i]), expected);
+        CHECK_STR(trashmap_image_get(clone.image, keys[i]), expected);
+    }
+    CHECK(!trashmap_image_has(clone.image, "key-missing"));
+    free(moved);
+    trashmap_reloc_deinit(&clone);
+}
+
+#ifdef TRASHMAP_MMAP
+#ifndef TRASHMAP_TEST_NAME
+#define TRASHMAP_TEST_NAME "trashmap_unit"
+#endif
+
+static void test_mapped(void) {
+    const char * path = TRASHMAP_TEST_NAME "_image.bin";
+    trashmap_t map;
+    trashmap_init(&map, 4);
+    for (int i = 0; i < KEY_COUNT; i++) trashmap_set(&map, keys[i], values[i]);
+    CHECK(trashmap_save(&map, path));
+    trashmap_deinit(&map);
+
+    trashmap_mapped_t mapped;
+    bool opened = trashmap_open_mapped(&mapped, path);
+    CHECK(opened);
+    if (!opened) {
+        remove(path);
+        return;
+    }
+    for (int i = 0; i < KEY_COUNT; i++) CHECK_STR(trashmap_image_get(mapped.image, keys[i]), values[i]);
+    CHECK(!trashmap_image_has(mapped.image, "key-missing"));
+    trashmap_close_mapped(&mapped);
+
+    // the same slot size with another slot layout, as a 32 bit TRASHMAP_SLOT_PREFIX build against TRASHMAP_64BIT
+    uint32_t format = TRASHMAP_IMAGE_FORMAT ^ 0x100u;
+    FILE * file = fopen(path, "r+b");
+    fseek(file, (long)offsetof(trashmap_image_t, format), SEEK_SET);
+    fwrite(&format, sizeof(format), 1, file);
+    fclose(file);
+    CHECK(!trashmap_open_mapped(&mapped, path));
+
+    file = fopen(path, "wb");
+    fputs("not a map image, not a map image, not a map image, not a map image", file);
+    fclose(file);
+    CHECK(!trashmap_open_mapped(&mapped, path));
+    CHECK(!trashmap_open_mapped(&mapped, "trashmap_unit_missing.bin"));
+    remove(path);
+}
+#endif // TRASHMAP_MMAP
+
+static const char header_block[] =
+    "Host: example.com\r\n"
+    "Content-Type:  text/html; charset=utf-8  \r\n"
+    "X-A-Header-Name-Long-Enough-For-Vector-Scanning: a value that is long enough to cross a couple of 32 byte chunks\r\n"
+    "Empty:\r\n"
+    "host: second\n"
+    "Accept: */*\r\n"
+    "\r\n"
+    "body";
+
+static void test_parse_headers(void) {
+    char * block = copy_string(header_block);
+    size_t len = strlen(block);
+    trashmap_t map;
+    trashmap_init(&map, 4);
+    // the parser terminates names and values in place, so the length is taken up front
+    CHECK(trashmap_parse_headers(&map, block, len) == len - 4);
+    CHECK(map.count == 5);
+    CHECK_STR(trashmap_get(&map, "host"), "second");
+    CHECK_STR(trashmap_get(&map, "content-type"), "text/html; charset=utf-8");
+    CHECK_STR(trashmap_get(&map, "x-a-header-name-long-enough-for-vector-scanning"), "a value that is long enough to cross a couple of 32 byte chunks");
+    CHECK_STR(trashmap_get(&map, "empty"), "");
+    CHECK_STR(trashmap_get(&map, "accept"), "*/*");
+    free(block);
+
+    // every prefix short of the empty line is incomplete and untouched, so a receive loop can retry on more data
+    block = copy_string(header_block);
+    for (size_t prefix = 0; prefix < len - 4; prefix++) {
+        trashmap_clear(&map);
+        CHECK(trashmap_parse_headers(&map, block, prefix) == 0);
+        CHECK(map.count == 0);
+        CHECK(memcmp(block, header_block, len) == 0);
+    }
+    CHECK(trashmap_parse_headers(&map, block, len) == len - 4);
+    CHECK_STR(trashmap_get(&map, "host"), "second");
+    free(block);
+
+    const char * invalid[] = {"Host: a\r\nX: b", "Host a\r\n\r\n", "Host : a\r\n\r\n", ": a\r\n\r\n", " folded\r\n\r\n", "\rx", "Ho st: a\r\n\r\n", "(x): a\r\n\r\n"};
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        trashmap_clear(&map);
+        char * bad = copy_string(invalid[i]);
+        CHECK(trashmap_parse_headers(&map, bad, strlen(bad)) == 0);
+        free(bad);
+    }
+    char empty[] = "\r\n";
+    CHECK(trashmap_parse_headers(&map, empty, 2) == 2);
+    trashmap_deinit(&map);
+}
+
+static void test_header_parser(void) {
+    size_t total = strlen(header_block);
+    char * whole = copy_string(header_block);
+    trashmap_t expected;
+    trashmap_init(&expected, 4);
+    size_t used = trashmap_parse_headers(&expected, whole, total);
+
+    // every chunk size, so every line is split at every position at least once
+    for (size_t chunk = 1; chunk <= total; chunk++) {
+        char * copy = copy_string(header_block);
+        trashmap_t map;
+        trashmap_init(&map, 2);
+        trashmap_header_parser_t parser;
+        trashmap_header_parser_init(&parser, &map);
+        size_t pos = 0, consumed = 0;
+        trashmap_parse_result_t result = TRASHMAP_PARSE_INCOMPLETE;
+        while (pos < total) {
+            size_t len = pos + chunk > total ? total - pos : chunk;
+            result = trashmap_header_parser_feed(&parser, copy + pos, len, &consumed);
+            if (result != TRASHMAP_PARSE_INCOMPLETE) break;
+            pos += len;
+        }
+        CHECK(result == TRASHMAP_PARSE_DONE);
+        CHECK(pos + consumed == used);
+        CHECK(map.count == expected.count);
+        for (size_t i = 0; i < expected.count; i++) {
+            CHECK_STR(trashmap_get(&map, expected.items[i].key), expected.items[i].value);
+        }
+        trashmap_header_parser_deinit(&parser);
+        trashmap_deinit(&map);
+        free(copy);
+    }
+
+    char bad[] = "Host a\r\n\r\n";
+    trashmap_header_parser_t parser;
+    size_t consumed;
+    trashmap_header_parser_init(&parser, &expected);
+    CHECK(trashmap_header_parser_feed(&parser, bad, 3, &consumed) == TRASHMAP_PARSE_INCOMPLETE);
+    CHECK(trashmap_header_parser_feed(&parser, bad + 3, sizeof(bad) - 4, &consumed) == TRASHMAP_PARSE_ERROR);
+    trashmap_header_parser_deinit(&parser);
+
+    // a space inside a name split across chunks
+    char spaced[] = "Ho st: a\r\n\r\n";
+    trashmap_header_parser_init(&parser, &expected);
+    CHECK(trashmap_header_parser_feed(&parser, spaced, 2, &consumed) == TRASHMAP_PARSE_INCOMPLETE);
+    CHECK(trashmap_header_parser_feed(&parser, spaced + 2, sizeof(spaced) - 3, &consumed) == TRASHMAP_PARSE_ERROR);
+    trashmap_header_parser_deinit(&parser);
+    trashmap_deinit(&expected);
+    free(whole);
+}
+
+#ifdef TRASHMAP_STATS
+static void test_stats(void) {
+    trashmap_t map;
+    trashmap_init(&map, 4);
+    for (int i = 0; i < 1000; i++) trashmap_set(&map, keys[i], values[i]);
+    trashmap_stats_t stats;
+    trashmap_stats(&map, &stats);
+    size_t histogram = 0;
+    for (size_t i = 0; i < TRASHMAP_PROBE_HISTOGRAM_SIZE; i++) histogram += stats.probe_histogram[i];
+    CHECK(histogram == 1000);
+    CHECK(stats.count == 1000);
+    CHECK(stats.rehash_count > 0);
+    CHECK(stats.clusters > 0 && stats.max_cluster >= 1);
+    CHECK(stats.load_factor > 0.0 && stats.load_factor <= 0.75);
+    CHECK(stats.bytes_allocated == trashmap_memory_usage(&map).total);
+    trashmap_deinit(&map);
+}
+#endif // TRASHMAP_STATS
+
+#ifdef TRASHMAP_FILTER
+static void test_filter(void) {
+    trashmap_t map;
+    trashmap_init(&map, 1);
+    for (int i = 0; i < KEY_COUNT / 2; i++) trashmap_set(&map, keys[i], values[i]);
+    // no false negatives after every rehash, and few false positives
+    size_t passed = 0;
+    for (int i = 0; i < KEY_COUNT; i++) {
+        bool may_have = trashmap_filter_may_have(&map, trashmap_hash(keys[i]));
+        if (i < KEY_COUNT / 2) CHECK(may_have);
+        else passed += may_have;
+    }
+    CHECK(passed < KEY_COUNT / 2 / 50);
+    for (int i = KEY_COUNT / 2; i < KEY_COUNT; i++) CHECK(!trashmap_has(&map, keys[i]));
+
+    trashmap_clear(&map);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(!trashmap_filter_may_have(&map, trashmap_hash(keys[i])));
+
+    trashmap_item_t pairs[KEY_COUNT];
+    for (int i = 0; i < KEY_COUNT; i++) {
+        pairs[i].key = keys[i];
+        pairs[i].value = values[i];
+    }
+    trashmap_build(&map, pairs, KEY_COUNT, 4);
+    for (int i = 0; i < KEY_COUNT; i++) CHECK(trashmap_filter_may_have(&map, trashmap_hash(keys[i])));
+    CHECK(((uintptr_t)map.filter & (sizeof(trashmap_filter_block_t) - 1)) == 0);
+    trashmap_deinit(&map);
+}
+#endif // TRASHMAP_FILTER
+
+#ifdef TRASHMAP_COUNTERS
+static void test_counters(void) {
+    trashmap_t map;
+    trashmap_init(&map, 4);
+    for (int i = 0; i < 100; i++) trashmap_set(&map, keys[i], values[i]);
+    trashmap_set(&map, keys[1], "x");
+    for (int i = 0; i < 100; i++) trashmap_get(&map, keys[i]);
+    trashmap_has(&map, "key-missing");
+    CHECK(map.counters.gets == 101);
+    CHECK(map.counters.hits == 100);
+    CHECK(map.counters.misses == 1);
+    CHECK(map.counters.sets == 101);
+    CHECK(map.counters.overwrites == 1);
+    CHECK(map.counters.resizes > 0);
+    CHECK(map.counters.probes + map.counters.filtered >= 202);
+#ifndef TRASHMAP_SLOT_PREFIX
+    // the slot prefix settles these short keys without a string compare
+    CHECK(map.counters.strcmps >= 101);
+#endif
+    trashmap_deinit(&map);
+}
+#endif // TRASHMAP_COUNTERS
+
+#ifdef TRASHMAP_COMPACT_SLOTS
+static void test_item_limit(void) {
+    // one more key than 16 bit slot indices can address
+    size_t count = (size_t)TRASHMAP_MAX_ITEMS + 1;
+    char (*many)[8] = (char (*)[8])malloc(count * sizeof(*many));
+    trashmap_item_t * pairs = (trashmap_item_t *)malloc(count * sizeof(*pairs));
+    for (size_t i = 0; i < count; i++) {
+        snprintf(many[i], sizeof(many[i]), "k%zu", i);
+        pairs[i].key = many[i];
+        pairs[i].value = many[i];
+    }
+
+    trashmap_t map;
+    trashmap_init(&map, 4);
+    bool all_set = true;
+    for (size_t i = 0; i < count - 1; i++) all_set &= trashmap_set(&map, many[i], many[i]);
+    CHECK(all_set);
+    CHECK(!trashmap_set(&map, many[count - 1], "lost"));
+    CHECK(!trashmap_reserve(&map, 1));
+    CHECK(map.count == count - 1);
+    CHECK(!trashmap_has(&map, many[count - 1]));
+    // a full map still updates the keys it holds
+    CHECK(trashmap_set(&map, many[7], "updated"));
+    CHECK_STR(trashmap_get(&map, many[7]), "updated");
+    CHECK_STR(trashmap_get(&map, many[count - 2]), many[count - 2]);
+
+    trashmap_t extra;
+    trashmap_init(&extra, 4);
+    trashmap_set(&extra, many[0], "merged");
+    trashmap_set(&extra, many[count - 1], "lost");
+    CHECK(!trashmap_merge(&map, &extra, TRASHMAP_MERGE_OVERWRITE));
+    CHECK(map.count == count - 1);
+    trashmap_deinit(&extra);
+
+    CHECK(!trashmap_build(&map, pairs, count, 1));
+    CHECK(map.count == count - 1);
+    CHECK(trashmap_build(&map, pairs, count - 1, 1));
+    CHECK_STR(trashmap_get(&map, many[count - 2]), many[count - 2]);
+    trashmap_deinit(&map);
+    free(pairs);
+    free(many);
+}
+#endif // TRASHMAP_COMPACT_SLOTS
+
+int main(void) {
+    make_keys();
+    test_streq();
+#ifdef TRASHMAP_MMAP
+    test_streq_page_boundary();
+#endif
+    test_hash();
+    test_basic();
+    test_growth();
+    test_shrink();
+    test_key_lengths();
+    test_build();
+    test_merge();
+    test_concurrent();
+    test_sharded();
+    test_cache();
+    test_cache_ttl();
+    test_pool();
+#ifdef TRASHMAP_TEST_THREADS
+    test_threads();
+#endif
+    test_image();
+#ifdef TRASHMAP_MMAP
+    test_mapped();
+#endif
+    test_parse_headers();
+    test_header_parser();
+#ifdef TRASHMAP_STATS
+    test_stats();
+#endif
+#ifdef TRASHMAP_FILTER
+    test_filter();
+#endif
+#ifdef TRASHMAP_COUNTERS
+    test_counters();
+#endif
+#ifdef TRASHMAP_COMPACT_SLOTS
+    test_item_limit();
+#endif
+#ifdef TRASHMAP_TEST_ALLOC
+    CHECK(test_allocations > 0);
+#endif
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
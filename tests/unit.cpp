@@ -0,0 +1,2 @@
+// builds unit.c as C++
+#include "unit.c"
@@ -3,7 +3,7 @@
 
 /**
  * Header only library for a string to string style append only hashmap
- * This library is not thread safe.
+ * This library is not thread safe, except for the trashmap_concurrent_t and trashmap_sharded_t variants.
  * Uses linear probing style hash map with an internal arena for map items.
  * Library works in C from c99 and C++ from c++20 without any warnings from `-Wall -Wextra -Wpedantic`.
  * This library was made for my own purposes for parsing HTTP headers but can be used in many contexts.
@@ -25,11 +25,40 @@
  * TRASHMAP_REALLOC(PTR, SIZE)
  * TRASHMAP_FREE(PTR)
  * 
+ * Slot arrays are allocated zeroed, an alternate allocator can also define TRASHMAP_CALLOC(COUNT, SIZE),
+ * otherwise TRASHMAP_ALLOC is followed by a memset.
+ * 
  * All asserts can be removed by defining `TRASHMAP_STRIP_ASSERTS` prior to including or using `-DTRASHMAP_STRIP_ASSERTS`
  * Alternatively the default assert function can be overwritten by creating a custom define for:
  * 
  * TRASHMAP_ASSERT(COND)
  * 
+ * Parallel work (trashmap_build) runs serially by default, to run it on a thread pool create a custom define for:
+ * 
+ * TRASHMAP_PARALLEL_FOR(TASK, CTX, COUNT)
+ * 
+ * which must call TASK(CTX, i) for every i in [0, COUNT) and only return once every call has finished.
+ * Defining it also splits the rehash in trashmap_reserve into TRASHMAP_PARALLEL_REHASH_TASKS (default 64) tasks
+ * for maps with at least TRASHMAP_PARALLEL_REHASH_MIN (default 65536) slots, both can be overwritten.
+ * 
+ * Key comparisons use SSE2, AVX2 or NEON vector loads that may read past the end of a key but never across a page,
+ * define TRASHMAP_PAGE_SIZE if the target's smallest page is smaller than 4096 bytes.
+ * 
+ * Defining TRASHMAP_SLOT_PREFIX grows slots to 16 bytes to also hold the key length and first 6 key bytes,
+ * so lookups only read a stored key once hash, length and prefix all match, and never for keys up to 6 bytes.
+ * 
+ * Defining TRASHMAP_COMPACT_SLOTS shrinks slots to 4 bytes (16 bit hash fragment and 16 bit index) for maps of
+ * at most 65535 items (TRASHMAP_MAX_ITEMS), rehashing then hashes every key again. past that limit inserting a
+ * new key fails rather than truncating its index, this check is kept with TRASHMAP_STRIP_ASSERTS.
+ * 
+ * Defining TRASHMAP_64BIT switches hashes (64 bit FNV-1a) and item indices to trashmap_hash_t/trashmap_index_t
+ * of 64 bits, growing slots to 16 bytes. Large maps then see far fewer false hash matches and can pass 4 billion items.
+ * trashmap_concurrent_t keeps 32 bit hashes and indices. It can't be combined with TRASHMAP_COMPACT_SLOTS.
+ * 
+ * Defining TRASHMAP_FILTER keeps a split block bloom filter next to the slot table (32 bytes per 16 slots),
+ * so trashmap_get and trashmap_has answer most misses from one cache line without probing.
+ * It is rebuilt whenever the slot table grows and reset by trashmap_clear.
+ * 
  * To use a custom hash function define `TRASHMAP_CUSTOM_HASH` above the implementing include,
  * and then implement a function with exact same signature, i.e.
  * 
@@ -38,8 +67,8 @@
  * #define TRASHMAP_IMPL
  * #include "trashmap.h"
  * 
- * // function must have this exact signature
- * uint32_t trashmap_hash(const char * key) {
+ * // function must have this exact signature, trashmap_hash_t is uint32_t unless TRASHMAP_64BIT is defined
+ * trashmap_hash_t trashmap_hash(const char * key) {
  *     // custom hash function implementation
  *     // ...
  * }
@@ -56,7 +85,7 @@
  * void trashmap_deinit(trashmap_t* map);
  * 
  * trashmap_hash: implementation of the FNV-1a hashing algorithm.
- * uint32_t trashmap_hash(const char * key);
+ * trashmap_hash_t trashmap_hash(const char * key);
  * 
  * trashmap_has: checks if the key appears in the hash map.
  * bool trashmap_has(const trashmap_t* map, const char * key);
@@ -66,10 +95,49 @@
  * 
  * trashmap_set: inserts an element into the hash map, or updates the value if it already exists.
  * does NOT duplicate strings, ensure all strings are allocated somewhere permanently before passing to trashmap_set.
- * void trashmap_set(trashmap_t* map, const char * key, const char * value);
+ * returns false, leaving the map unchanged, if a new key would take the map past TRASHMAP_MAX_ITEMS.
+ * bool trashmap_set(trashmap_t* map, const char * key, const char * value);
  * 
  * trashmap_reserve: reserves enough space for `extra` addition items
- * void trashmap_reserve(trashmap_t* map, size_t extra);
+ * returns false, leaving the map unchanged, if that would take the map past TRASHMAP_MAX_ITEMS.
+ * bool trashmap_reserve(trashmap_t* map, size_t extra);
+ * 
+ * trashmap_shrink_to_fit: trims the items to exactly `count` and halves the slot table while it stays at most 75% full,
+ * rehashing into the smaller table. memory is otherwise never returned before trashmap_deinit.
+ * void trashmap_shrink_to_fit(trashmap_t* map);
+ * 
+ * trashmap_clear_shrink: same as trashmap_clear, but a slot table of more than `slot_watermark` slots is replaced
+ * with one of `slot_watermark` slots and the items trimmed to match, so one outlier does not pin its memory.
+ * void trashmap_clear_shrink(trashmap_t* map, size_t slot_watermark);
+ * 
+ * trashmap_memory_usage: reports the exact bytes allocated by the hash map for slots, items and the filter.
+ * keys and values are owned by the caller so are not included.
+ * trashmap_memory_t trashmap_memory_usage(const trashmap_t* map);
+ * 
+ * trashmap_build: replaces the contents of the hash map with `count` key/value pairs, later duplicate keys win.
+ * presizes the map once then hashes and fills slot ranges on up to `threads` tasks using TRASHMAP_PARALLEL_FOR.
+ * does NOT duplicate strings. returns false, leaving the map unchanged, if `count` is past TRASHMAP_MAX_ITEMS.
+ * bool trashmap_build(trashmap_t* map, const trashmap_item_t * pairs, size_t count, size_t threads);
+ * 
+ * trashmap_merge: inserts every pair of `src` into `dst`. keys in both keep the value in `dst` with TRASHMAP_MERGE_KEEP
+ * or take the one from `src` with TRASHMAP_MERGE_OVERWRITE. `dst` is reserved once and the hashes stored in the
+ * slots of `src` are reused, so no key is hashed again except with TRASHMAP_COMPACT_SLOTS, whose slots only keep
+ * a hash fragment. pairs are added in the order of `src->items`. does NOT duplicate strings.
+ * returns false if `dst` filled up to TRASHMAP_MAX_ITEMS, pairs of `src` before that point have been merged.
+ * bool trashmap_merge(trashmap_t* dst, const trashmap_t* src, trashmap_merge_policy_t policy);
+ * 
+ * trashmap_overlay_t is a read only view over `count` maps without copying any of them, a lookup tries each layer
+ * in order and the first one holding the key wins. the key is hashed once for all layers.
+ * the maps and the `layers` array are borrowed, so must outlive the overlay.
+ * 
+ * trashmap_overlay_init: initialize an overlay of `count` maps, `layers[0]` is searched first.
+ * void trashmap_overlay_init(trashmap_overlay_t* overlay, const trashmap_t* const * layers, size_t count);
+ * 
+ * trashmap_overlay_has: checks if the key appears in any layer.
+ * bool trashmap_overlay_has(const trashmap_overlay_t* overlay, const char * key);
+ * 
+ * trashmap_overlay_get: gets the value for the key from the first layer holding it, NULL if no layer does.
+ * const char* trashmap_overlay_get(const trashmap_overlay_t* overlay, const char * key);
  * 
  * Reimplementation of needed string.h functionality. 
  * This removes string.h as a dependency and means that the only dependency is malloc/realloc/free
@@ -80,6 +148,197 @@
  * trashmap_memset: reimplementation of libc memset
  * void * trashmap_memset(void * dest, unsigned char byte, size_t count);
  * 
+ * Statistics:
+ * 
+ * define `TRASHMAP_STATS` to enable trashmap_stats and track rehashes, it is compiled out entirely otherwise.
+ * 
+ * trashmap_stats: walks the slot array and reports load factor, a probe length histogram, max displacement,
+ * clusters, full hash collisions, rehash count and bytes allocated.
+ * void trashmap_stats(const trashmap_t* map, trashmap_stats_t* out);
+ * 
+ * define `TRASHMAP_COUNTERS` to keep running totals of operations in `map->counters` (gets, hits, misses, sets,
+ * overwrites, resizes, probes, strcmps and filtered), zeroed by trashmap_init.
+ * 
+ * resizes and long probes can be traced by creating custom defines for:
+ * 
+ * TRASHMAP_ON_RESIZE(MAP, OLD_SLOT_COUNT, NEW_SLOT_COUNT)
+ * TRASHMAP_ON_LONG_PROBE(MAP, KEY, PROBES)
+ * 
+ * long probes are those visiting at least TRASHMAP_LONG_PROBE (default 16) slots.
+ * 
+ * HTTP headers:
+ * 
+ * trashmap_parse_headers: parses a block of HTTP header lines (`name: value`, terminated by an empty line) into the hash map.
+ * `buf` is modified in place: names are lowercased and names and values are nul terminated, so the map
+ * points straight into `buf` which must outlive it. repeated names keep the last value.
+ * a name with any byte that is not an RFC 9110 token character makes the block malformed.
+ * returns the number of bytes consumed including the empty line, or 0 if the block is incomplete, malformed or the map is full.
+ * an incomplete block (no empty line within `len`) leaves `buf` and the map untouched, so the call can be repeated once more is read.
+ * size_t trashmap_parse_headers(trashmap_t* map, char * buf, size_t len);
+ * 
+ * trashmap_header_parser_t is a resumable version of trashmap_parse_headers for header blocks split across reads.
+ * lines within one chunk are used in place, only lines split across chunks are copied into the parser's spill arena.
+ * 
+ * trashmap_header_parser_init: initialize a header parser which inserts into `map`.
+ * void trashmap_header_parser_init(trashmap_header_parser_t* parser, trashmap_t* map);
+ * 
+ * trashmap_header_parser_deinit: release the parser's spill arena, map entries for lines split across chunks are no longer valid.
+ * void trashmap_header_parser_deinit(trashmap_header_parser_t* parser);
+ * 
+ * trashmap_header_parser_feed: feeds the next chunk of a header block to the parser.
+ * each chunk is modified in place and must outlive the map. on TRASHMAP_PARSE_DONE `consumed` is set to the bytes
+ * of this chunk used up to and including the empty line.
+ * trashmap_parse_result_t trashmap_header_parser_feed(trashmap_header_parser_t* parser, char * chunk, size_t len, size_t * consumed);
+ * 
+ * Map images:
+ * 
+ * a map image is a flat, position independent copy of a map, with keys and values stored as offsets into
+ * a block of strings inside the image. images use the native byte order and slot format.
+ * 
+ * trashmap_image_has: checks if the key appears in the map image.
+ * bool trashmap_image_has(const trashmap_image_t* image, const char * key);
+ * 
+ * trashmap_image_get: gets the associated value for the key, NULL if key does not appear in the map image.
+ * const char* trashmap_image_get(const trashmap_image_t* image, const char * key);
+ * 
+ * trashmap_reloc_t is a map stored as a single growable map image which owns copies of its keys and values.
+ * the image (map.image, map.size bytes) can be copied anywhere and read with trashmap_image_get.
+ * 
+ * trashmap_reloc_init: initialize an empty relocatable hashmap with `count` initial slots.
+ * void trashmap_reloc_init(trashmap_reloc_t* map, size_t count);
+ * 
+ * trashmap_reloc_deinit: release all resources associated with relocatable hashmap.
+ * void trashmap_reloc_deinit(trashmap_reloc_t* map);
+ * 
+ * trashmap_reloc_set: inserts an element into the relocatable hash map, or updates the value if it already exists.
+ * copies the key and value into the image, replaced values are not reclaimed.
+ * returns false, leaving the map unchanged, if a new key would take the map past TRASHMAP_MAX_ITEMS.
+ * bool trashmap_reloc_set(trashmap_reloc_t* map, const char * key, const char * value);
+ * 
+ * trashmap_reloc_clone: initialize `dst` as a copy of `src` with a single allocation and memcpy.
+ * void trashmap_reloc_clone(trashmap_reloc_t* dst, const trashmap_reloc_t* src);
+ * 
+ * define `TRASHMAP_MMAP` to enable saving and memory mapping images, this requires stdio and POSIX mmap.
+ * 
+ * trashmap_save: writes the hash map as a map image to the file at `path`, returns false on failure.
+ * bool trashmap_save(const trashmap_t* map, const char * path);
+ * 
+ * trashmap_open_mapped: maps a map image written by trashmap_save read only into memory, returns false on failure.
+ * lookups go through trashmap_image_get(mapped->image, key) without any parsing or allocation.
+ * bool trashmap_open_mapped(trashmap_mapped_t* mapped, const char * path);
+ * 
+ * trashmap_close_mapped: unmaps a map image, strings returned by trashmap_image_get are no longer valid.
+ * void trashmap_close_mapped(trashmap_mapped_t* mapped);
+ * 
+ * Concurrent variant:
+ * 
+ * trashmap_concurrent_t is a fixed capacity, append only map which is safe to use from many threads at once.
+ * slots are claimed with a compare and swap, items are bump allocated from an arena and lookups are wait-free.
+ * requires the gcc/clang `__atomic` builtins.
+ * 
+ * trashmap_concurrent_init: initialize an empty concurrent hashmap with room for `capacity` items.
+ * void trashmap_concurrent_init(trashmap_concurrent_t* map, size_t capacity);
+ * 
+ * trashmap_concurrent_deinit: release all resources associated with concurrent hashmap, must not race with any other call.
+ * void trashmap_concurrent_deinit(trashmap_concurrent_t* map);
+ * 
+ * trashmap_concurrent_has: checks if the key appears in the concurrent hash map.
+ * bool trashmap_concurrent_has(const trashmap_concurrent_t* map, const char * key);
+ * 
+ * trashmap_concurrent_get: gets the associated value for the key, NULL if key does not appear in the concurrent hash map.
+ * const char* trashmap_concurrent_get(const trashmap_concurrent_t* map, const char * key);
+ * 
+ * trashmap_concurrent_set: inserts an element into the concurrent hash map, or updates the value if it already exists.
+ * returns false if the item arena is full. does NOT duplicate strings.
+ * bool trashmap_concurrent_set(trashmap_concurrent_t* map, const char * key, const char * value);
+ * 
+ * Sharded variant:
+ * 
+ * trashmap_sharded_t splits keys across independent trashmap_t shards by the high bits of their remixed hash.
+ * each shard has its own reader-writer spinlock and its own slots and items, so a resize only stalls its own shard.
+ * requires the gcc/clang `__atomic` builtins. the busy wait hint can be overwritten by defining TRASHMAP_SPIN_PAUSE().
+ * 
+ * trashmap_sharded_init: initialize an empty sharded hashmap with `shard_count` shards (a power of two) each with `count` initial slots.
+ * void trashmap_sharded_init(trashmap_sharded_t* map, size_t shard_count, size_t count);
+ * 
+ * trashmap_sharded_deinit: release all resources associated with sharded hashmap, must not race with any other call.
+ * void trashmap_sharded_deinit(trashmap_sharded_t* map);
+ * 
+ * trashmap_sharded_has: checks if the key appears in the sharded hash map.
+ * bool trashmap_sharded_has(trashmap_sharded_t* map, const char * key);
+ * 
+ * trashmap_sharded_get: gets the associated value for the key, NULL if key does not appear in the sharded hash map.
+ * const char* trashmap_sharded_get(trashmap_sharded_t* map, const char * key);
+ * 
+ * trashmap_sharded_set: inserts an element into the sharded hash map, or updates the value if it already exists.
+ * returns false if the key's shard is full, as trashmap_set.
+ * bool trashmap_sharded_set(trashmap_sharded_t* map, const char * key, const char * value);
+ * 
+ * Cache variant:
+ * 
+ * trashmap_cache_t is a trashmap_t holding at most `capacity` items, once full each new key evicts an old one.
+ * victims are picked with CLOCK: a hand sweeps the items, skipping (and clearing) those read since it last passed.
+ * evicted slots are removed with backward shift deletion, so lookups never need tombstones.
+ * every key/value pair passed to trashmap_cache_set is handed to the eviction callback exactly once, when it is
+ * evicted, replaced by a later set of the same key, cleared or deinitialized, so the callback can free them.
+ * 
+ * trashmap_cache_init: initialize an empty cache for up to `capacity` items, `on_evict` may be NULL.
+ * `capacity` is clamped to TRASHMAP_MAX_ITEMS.
+ * void trashmap_cache_init(trashmap_cache_t* cache, size_t capacity, trashmap_evict_fn on_evict, void * ctx);
+ * 
+ * trashmap_cache_deinit: hands every remaining pair to the eviction callback then releases all resources.
+ * void trashmap_cache_deinit(trashmap_cache_t* cache);
+ * 
+ * trashmap_cache_clear: hands every pair to the eviction callback and empties the cache, keeping its memory.
+ * void trashmap_cache_clear(trashmap_cache_t* cache);
+ * 
+ * trashmap_cache_has: checks if the key appears in the cache and has not expired, without counting as a use.
+ * bool trashmap_cache_has(const trashmap_cache_t* cache, const char * key);
+ * 
+ * trashmap_cache_get: gets the associated value for the key and marks it as used, NULL if key does not appear.
+ * an expired item is removed and handed to the eviction callback.
+ * const char* trashmap_cache_get(trashmap_cache_t* cache, const char * key);
+ * 
+ * trashmap_cache_set: inserts an element, evicting one if the cache is full, or replaces the key and value if it exists.
+ * the item never expires. does NOT duplicate strings.
+ * void trashmap_cache_set(trashmap_cache_t* cache, const char * key, const char * value);
+ * 
+ * items can also expire. once a clock is set, expired items are removed lazily by trashmap_cache_get and in bounded
+ * steps by trashmap_cache_sweep, their places in the arena are reused before anything is evicted.
+ * the eviction hand does not skip an expired item, even if it was read.
+ * 
+ * trashmap_cache_set_clock: enables expiry, `clock` is called with `ctx` whenever the cache needs the current time.
+ * void trashmap_cache_set_clock(trashmap_cache_t* cache, trashmap_clock_fn clock, void * ctx);
+ * 
+ * trashmap_cache_set_ttl: same as trashmap_cache_set but the item expires `ttl` clock units from now, requires a clock.
+ * void trashmap_cache_set_ttl(trashmap_cache_t* cache, const char * key, const char * value, uint64_t ttl);
+ * 
+ * trashmap_cache_sweep: checks at most `budget` items from where the last sweep stopped and removes the expired ones.
+ * returns how many were removed.
+ * size_t trashmap_cache_sweep(trashmap_cache_t* cache, size_t budget);
+ * 
+ * Map pool:
+ * 
+ * trashmap_pool_t keeps idle maps for reuse, so maps living for one request skip trashmap_init and trashmap_deinit.
+ * released maps are cleared with trashmap_clear_shrink, so an outlier goes back to the pool at the watermark size.
+ * a pool is not thread safe, give each thread its own.
+ * 
+ * trashmap_pool_init: initialize an empty pool handing out maps of `slot_count` slots, keeping up to `max_idle` of them.
+ * released maps above `slot_watermark` slots are shrunk back to it.
+ * void trashmap_pool_init(trashmap_pool_t* pool, size_t slot_count, size_t slot_watermark, size_t max_idle);
+ * 
+ * trashmap_pool_deinit: releases every idle map, maps still acquired must be released or deinitialized separately.
+ * void trashmap_pool_deinit(trashmap_pool_t* pool);
+ * 
+ * trashmap_pool_acquire: initializes `map` as an empty map, reusing an idle one if there is one.
+ * void trashmap_pool_acquire(trashmap_pool_t* pool, trashmap_t* map);
+ * 
+ * trashmap_pool_release: clears `map` and keeps it for the next acquire, or deinitializes it once `max_idle` are kept.
+ * void trashmap_pool_release(trashmap_pool_t* pool, trashmap_t* map);
+ * 
+ * trashmap_pool_trim: deinitializes idle maps until at most `keep` remain.
+ * void trashmap_pool_trim(trashmap_pool_t* pool, size_t keep);
+ * 
  * 
  * 
  * TODO:
@@ -101,21 +360,96 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#ifdef TRASHMAP_64BIT
+// 64 bit hashes and item indices, fewer false hash matches in huge maps and no 4 billion item limit
+typedef uint64_t trashmap_hash_t;
+typedef uint64_t trashmap_index_t;
+#else
+typedef uint32_t trashmap_hash_t;
+typedef uint32_t trashmap_index_t;
+#endif // TRASHMAP_64BIT
+
+#ifdef TRASHMAP_COMPACT_SLOTS
+#ifdef TRASHMAP_SLOT_PREFIX
+#error "TRASHMAP_COMPACT_SLOTS and TRASHMAP_SLOT_PREFIX can't be combined"
+#endif // TRASHMAP_SLOT_PREFIX
+#ifdef TRASHMAP_64BIT
+#error "TRASHMAP_COMPACT_SLOTS and TRASHMAP_64BIT can't be combined"
+#endif // TRASHMAP_64BIT
+
+// 4 byte slots for maps of at most 65535 items, inserts past that fail.
+// only the top 16 bits of the hash are kept, so keys are hashed again to find their home slot when rehashing
 typedef struct trashmap_slot_t {
-    uint32_t hash;
-    uint32_t index;
+    uint16_t hash;
+    // index of the item plus one, 0 when the slot is empty so zeroed memory is an empty table
+    uint16_t index;
 } trashmap_slot_t;
 
+#define TRASHMAP_MAX_ITEMS UINT16_MAX
+#else
+typedef struct trashmap_slot_t {
+    trashmap_hash_t hash;
+    // index of the item plus one, 0 when the slot is empty so zeroed memory is an empty table
+    trashmap_index_t index;
+#ifdef TRASHMAP_SLOT_PREFIX
+    // key length (saturated at UINT16_MAX) in the low 16 bits and its first 6 bytes above, zero padded.
+    // a mismatch rules a slot out and keys of up to 6 bytes match without reading the key
+    uint64_t tag;
+#endif // TRASHMAP_SLOT_PREFIX
+} trashmap_slot_t;
+
+#ifdef TRASHMAP_64BIT
+#define TRASHMAP_MAX_ITEMS (SIZE_MAX / 2)
+#else
+#define TRASHMAP_MAX_ITEMS UINT32_MAX
+#endif // TRASHMAP_64BIT
+#endif // TRASHMAP_COMPACT_SLOTS
+
 typedef struct trashmap_item_t {
     const char * key, * value;
 } trashmap_item_t;
 
+#ifdef TRASHMAP_COUNTERS
+// running totals of map operations, zeroed by trashmap_init. only with TRASHMAP_COUNTERS defined.
+// lookups on a const map still update them, they are not atomic so concurrent readers may undercount.
+typedef struct trashmap_counters_t {
+    // calls to trashmap_get and trashmap_has, split into hits and misses
+    size_t gets, hits, misses;
+    // calls to trashmap_set, overwrites replaced the value of an existing key
+    size_t sets, overwrites;
+    size_t resizes;
+    // slots visited while probing and full key comparisons made after a hash match
+    size_t probes, strcmps;
+    // misses answered by the filter without probing, only with TRASHMAP_FILTER
+    size_t filtered;
+} trashmap_counters_t;
+#endif // TRASHMAP_COUNTERS
+
+#ifdef TRASHMAP_FILTER
+// one bit is set in each word for every key, so a lookup reads a single 32 byte aligned block
+typedef struct trashmap_filter_block_t {
+    uint32_t words[8];
+} trashmap_filter_block_t;
+#endif // TRASHMAP_FILTER
+
 typedef struct trashmap_t {
     trashmap_slot_t * slots;
     trashmap_item_t * items;
     size_t slot_count;
     size_t count;
     size_t capacity;
+#ifdef TRASHMAP_FILTER
+    // aligned into `filter_alloc`, sized from the slot count
+    trashmap_filter_block_t * filter;
+    size_t filter_blocks;
+    void * filter_alloc;
+#endif // TRASHMAP_FILTER
+#ifdef TRASHMAP_STATS
+    size_t rehash_count;
+#endif // TRASHMAP_STATS
+#ifdef TRASHMAP_COUNTERS
+    trashmap_counters_t counters;
+#endif // TRASHMAP_COUNTERS
 } trashmap_t;
 
 // initialize an empty hashmap with `count` initial slots.
@@ -128,10 +462,17 @@ void trashmap_deinit(trashmap_t* map);
 void trashmap_clear(trashmap_t* map);
 
 // implementation of the FNV-1a hashing algorithm
-uint32_t trashmap_hash(const char * key);
+trashmap_hash_t trashmap_hash(const char * key);
 
-// reserves enough space for `extra` addition items
-void trashmap_reserve(trashmap_t* map, size_t extra);
+// reserves enough space for `extra` addition items, false if that would pass TRASHMAP_MAX_ITEMS.
+bool trashmap_reserve(trashmap_t* map, size_t extra);
+
+// trims the items to exactly `count` and halves the slot table while it stays at most 75% full.
+void trashmap_shrink_to_fit(trashmap_t* map);
+
+// same as trashmap_clear, but a slot table of more than `slot_watermark` slots is replaced with one of
+// `slot_watermark` slots and the items trimmed to match.
+void trashmap_clear_shrink(trashmap_t* map, size_t slot_watermark);
 
 // reimplementation of libc strcmp
 int trashmap_strcmp(const char * lhs, const char * rhs);
@@ -147,7 +488,368 @@ const char* trashmap_get(const trashmap_t* map, const char * key);
 
 // inserts an element into the hash map, or updates the value if it already exists.
 // does NOT duplicate strings, ensure all strings are allocated somewhere permanently before passing to trashmap_set.
-void trashmap_set(trashmap_t* map, const char * key, const char * value);
+// false, leaving the map unchanged, if a new key would pass TRASHMAP_MAX_ITEMS.
+bool trashmap_set(trashmap_t* map, const char * key, const char * value);
+
+// bytes allocated by the hash map, keys and values are owned by the caller so are not included.
+typedef struct trashmap_memory_t {
+    size_t slots;
+    size_t items;
+    // part of `items` allocated but not yet holding an item
+    size_t unused_items;
+    // the bloom filter, 0 without TRASHMAP_FILTER
+    size_t filter;
+    size_t total;
+} trashmap_memory_t;
+
+// reports the exact bytes allocated by the hash map for each component.
+trashmap_memory_t trashmap_memory_usage(const trashmap_t* map);
+
+#ifdef TRASHMAP_STATS
+#ifndef TRASHMAP_PROBE_HISTOGRAM_SIZE
+#define TRASHMAP_PROBE_HISTOGRAM_SIZE 16
+#endif // TRASHMAP_PROBE_HISTOGRAM_SIZE
+
+typedef struct trashmap_stats_t {
+    size_t count;
+    size_t slot_count;
+    double load_factor;
+    // probe_histogram[i] counts items stored i slots after their home slot, the last bucket also counts longer probes
+    size_t probe_histogram[TRASHMAP_PROBE_HISTOGRAM_SIZE];
+    size_t max_displacement;
+    double mean_displacement;
+    // runs of consecutive occupied slots
+    size_t clusters;
+    size_t max_cluster;
+    // items whose full hash matches an item with a different key
+    size_t hash_collisions;
+    size_t rehash_count;
+    // bytes currently allocated for slots and items
+    size_t bytes_allocated;
+} trashmap_stats_t;
+
+// walks the slot array and reports how probing in the hash map behaves. only with TRASHMAP_STATS defined.
+void trashmap_stats(const trashmap_t* map, trashmap_stats_t* out);
+#endif // TRASHMAP_STATS
+
+// replaces the contents of the hash map with `count` key/value pairs, later duplicate keys win.
+// presizes the map once then hashes and fills slot ranges on up to `threads` tasks using TRASHMAP_PARALLEL_FOR.
+// does NOT duplicate strings. false, leaving the map unchanged, if `count` is past TRASHMAP_MAX_ITEMS.
+bool trashmap_build(trashmap_t* map, const trashmap_item_t * pairs, size_t count, size_t threads);
+
+// what trashmap_merge does with a key already in the destination
+typedef enum trashmap_merge_policy_t {
+    TRASHMAP_MERGE_KEEP,
+    TRASHMAP_MERGE_OVERWRITE,
+} trashmap_merge_policy_t;
+
+// inserts every pair of `src` into `dst`, keys in both are resolved by `policy`.
+// `dst` is reserved once and the hashes stored in `src` are reused, unless TRASHMAP_COMPACT_SLOTS.
+// pairs are added in the order of `src->items`. does NOT duplicate strings.
+// false if `dst` filled up to TRASHMAP_MAX_ITEMS part way through.
+bool trashmap_merge(trashmap_t* dst, const trashmap_t* src, trashmap_merge_policy_t policy);
+
+// a read only view over several maps, the first layer holding a key wins. nothing is copied,
+// the maps and the `layers` array are borrowed.
+typedef struct trashmap_overlay_t {
+    const trashmap_t* const * layers;
+    size_t count;
+} trashmap_overlay_t;
+
+// initialize an overlay of `count` maps, `layers[0]` is searched first.
+void trashmap_overlay_init(trashmap_overlay_t* overlay, const trashmap_t* const * layers, size_t count);
+
+// checks if the key appears in any layer.
+bool trashmap_overlay_has(const trashmap_overlay_t* overlay, const char * key);
+
+// gets the value for the key from the first layer holding it, NULL if no layer does.
+const char* trashmap_overlay_get(const trashmap_overlay_t* overlay, const char * key);
+
+// header of a flat, position independent map image. followed by `slot_count` trashmap_slot_t,
+// `capacity` trashmap_image_item_t (the first `count` in use) and `strings_capacity` bytes
+// of nul terminated keys and values (the first `strings_size` in use).
+// images use the native byte order and slot format so are only portable between identical builds.
+typedef struct trashmap_image_t {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    // TRASHMAP_IMAGE_FORMAT of the writing build, slot sizes alone don't tell every slot layout apart
+    uint32_t format;
+    uint64_t slot_count;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t strings_size;
+    uint64_t strings_capacity;
+} trashmap_image_t;
+
+// key and value as byte offsets from the start of the image's strings
+typedef struct trashmap_image_item_t {
+    uint32_t key, value;
+} trashmap_image_item_t;
+
+#define TRASHMAP_IMAGE_MAGIC 0x50414d54u
+#define TRASHMAP_IMAGE_VERSION 3u
+
+#ifdef TRASHMAP_SLOT_PREFIX
+#define TRASHMAP_IMAGE_FORMAT_SLOT_PREFIX 0x100u
+#else
+#define TRASHMAP_IMAGE_FORMAT_SLOT_PREFIX 0u
+#endif // TRASHMAP_SLOT_PREFIX
+#ifdef TRASHMAP_COMPACT_SLOTS
+#define TRASHMAP_IMAGE_FORMAT_COMPACT_SLOTS 0x200u
+#else
+#define TRASHMAP_IMAGE_FORMAT_COMPACT_SLOTS 0u
+#endif // TRASHMAP_COMPACT_SLOTS
+// hash width in bytes in the low byte, then one bit per slot layout option
+#define TRASHMAP_IMAGE_FORMAT ((uint32_t)sizeof(trashmap_hash_t) | TRASHMAP_IMAGE_FORMAT_SLOT_PREFIX | TRASHMAP_IMAGE_FORMAT_COMPACT_SLOTS)
+
+// checks if the key appears in the map image.
+bool trashmap_image_has(const trashmap_image_t* image, const char * key);
+
+// gets the associated value for the key, NULL if key does not appear in the map image.
+// the returned string points into the image.
+const char* trashmap_image_get(const trashmap_image_t* image, const char * key);
+
+// a map stored as a single growable map image which owns copies of its keys and values.
+// the image can be copied anywhere (another buffer, shared memory, a file) and read with trashmap_image_get.
+typedef struct trashmap_reloc_t {
+    trashmap_image_t* image;
+    // total bytes in the image
+    size_t size;
+} trashmap_reloc_t;
+
+// initialize an empty relocatable hashmap with `count` initial slots.
+void trashmap_reloc_init(trashmap_reloc_t* map, size_t count);
+
+// release all resources associated with relocatable hashmap.
+void trashmap_reloc_deinit(trashmap_reloc_t* map);
+
+// inserts an element into the relocatable hash map, or updates the value if it already exists.
+// copies the key and value into the image, replaced values are not reclaimed.
+bool trashmap_reloc_set(trashmap_reloc_t* map, const char * key, const char * value);
+
+// initialize `dst` as a copy of `src` with a single allocation and memcpy.
+void trashmap_reloc_clone(trashmap_reloc_t* dst, const trashmap_reloc_t* src);
+
+#ifdef TRASHMAP_MMAP
+typedef struct trashmap_mapped_t {
+    const trashmap_image_t* image;
+    size_t size;
+} trashmap_mapped_t;
+
+// writes the hash map as a map image to the file at `path`, returns false on failure.
+bool trashmap_save(const trashmap_t* map, const char * path);
+
+// maps a map image written by trashmap_save read only into memory, returns false on failure.
+// lookups go through trashmap_image_get(mapped->image, key) without any parsing or allocation.
+bool trashmap_open_mapped(trashmap_mapped_t* mapped, const char * path);
+
+// unmaps a map image, strings returned by trashmap_image_get are no longer valid.
+void trashmap_close_mapped(trashmap_mapped_t* mapped);
+#endif // TRASHMAP_MMAP
+
+// parses a block of HTTP header lines (`name: value`, terminated by an empty line) into the hash map.
+// `buf` is modified in place: names are lowercased and names and values are nul terminated, so the map
+// points straight into `buf` which must outlive it. repeated names keep the last value.
+// returns the number of bytes consumed including the empty line, or 0 if the block is incomplete, malformed or the map is full.
+// an incomplete block leaves the map and `buf` untouched so the call can be repeated once more is read,
+// otherwise their contents are unspecified.
+size_t trashmap_parse_headers(trashmap_t* map, char * buf, size_t len);
+
+typedef enum trashmap_parse_result_t {
+    TRASHMAP_PARSE_INCOMPLETE,
+    TRASHMAP_PARSE_DONE,
+    TRASHMAP_PARSE_ERROR,
+} trashmap_parse_result_t;
+
+typedef enum trashmap_header_state_t {
+    TRASHMAP_HEADER_LINE_START,
+    TRASHMAP_HEADER_BLANK_CR,
+    TRASHMAP_HEADER_NAME,
+    TRASHMAP_HEADER_VALUE,
+    TRASHMAP_HEADER_DONE,
+    TRASHMAP_HEADER_ERROR,
+} trashmap_header_state_t;
+
+typedef struct trashmap_header_spill_t {
+    struct trashmap_header_spill_t * next;
+    size_t capacity;
+    size_t used;
+} trashmap_header_spill_t;
+
+// resumable version of trashmap_parse_headers which accepts the header block a chunk at a time.
+typedef struct trashmap_header_parser_t {
+    trashmap_t* map;
+    // lines split across chunks are copied here, the newest block is first and holds the current line after `used`
+    trashmap_header_spill_t * spill;
+    trashmap_header_state_t state;
+    // true once the current line has been copied into the spill arena
+    bool spilled;
+    // length of the current line held in the spill arena
+    size_t line_len;
+    size_t name_len;
+    // FNV-1a state of the lowercased name so far
+    trashmap_hash_t hash;
+} trashmap_header_parser_t;
+
+// initialize a header parser which inserts into `map`.
+void trashmap_header_parser_init(trashmap_header_parser_t* parser, trashmap_t* map);
+
+// release the parser's spill arena, any map entries for lines split across chunks are no longer valid.
+void trashmap_header_parser_deinit(trashmap_header_parser_t* parser);
+
+// feeds the next chunk of a header block to the parser. each chunk is modified in place the same way as
+// trashmap_parse_headers and must outlive the map, only lines split across chunks are copied.
+// on TRASHMAP_PARSE_DONE `consumed` is set to the bytes of this chunk used up to and including the empty line.
+trashmap_parse_result_t trashmap_header_parser_feed(trashmap_header_parser_t* parser, char * chunk, size_t len, size_t * consumed);
+
+typedef struct trashmap_concurrent_t {
+    // packed as (hash << 32 | index + 1), 0 when empty
+    uint64_t * slots;
+    trashmap_item_t * items;
+    size_t slot_count;
+    size_t capacity;
+    // next unclaimed item in the arena, may exceed capacity once the arena is full
+    size_t count;
+} trashmap_concurrent_t;
+
+// initialize an empty concurrent hashmap with room for `capacity` items.
+void trashmap_concurrent_init(trashmap_concurrent_t* map, size_t capacity);
+
+// release all resources associated with concurrent hashmap, must not race with any other call.
+void trashmap_concurrent_deinit(trashmap_concurrent_t* map);
+
+// checks if the key appears in the concurrent hash map. wait-free.
+bool trashmap_concurrent_has(const trashmap_concurrent_t* map, const char * key);
+
+// gets the associated value for the key, NULL if key does not appear in the concurrent hash map. wait-free.
+const char* trashmap_concurrent_get(const trashmap_concurrent_t* map, const char * key);
+
+// inserts an element into the concurrent hash map, or updates the value if it already exists.
+// returns false if the item arena is full. does NOT duplicate strings.
+bool trashmap_concurrent_set(trashmap_concurrent_t* map, const char * key, const char * value);
+
+#ifndef TRASHMAP_CACHE_LINE
+#define TRASHMAP_CACHE_LINE 64
+#endif // TRASHMAP_CACHE_LINE
+
+typedef struct trashmap_shard_t {
+    trashmap_t map;
+    // reader-writer spinlock, TRASHMAP_SHARD_WRITER when held by a writer otherwise the number of readers
+    uint32_t lock;
+    // keeps neighbouring shard locks off the same cache line
+    unsigned char padding[TRASHMAP_CACHE_LINE - (sizeof(trashmap_t) + sizeof(uint32_t)) % TRASHMAP_CACHE_LINE];
+} trashmap_shard_t;
+
+typedef struct trashmap_sharded_t {
+    trashmap_shard_t * shards;
+    size_t shard_count;
+    // log2(shard_count), shards are selected by the top `shard_bits` bits of the remixed hash
+    unsigned shard_bits;
+} trashmap_sharded_t;
+
+// initialize an empty sharded hashmap with `shard_count` shards (a power of two) each with `count` initial slots.
+void trashmap_sharded_init(trashmap_sharded_t* map, size_t shard_count, size_t count);
+
+// release all resources associated with sharded hashmap, must not race with any other call.
+void trashmap_sharded_deinit(trashmap_sharded_t* map);
+
+// checks if the key appears in the sharded hash map.
+bool trashmap_sharded_has(trashmap_sharded_t* map, const char * key);
+
+// gets the associated value for the key, NULL if key does not appear in the sharded hash map.
+const char* trashmap_sharded_get(trashmap_sharded_t* map, const char * key);
+
+// inserts an element into the sharded hash map, or updates the value if it already exists.
+// does NOT duplicate strings.
+bool trashmap_sharded_set(trashmap_sharded_t* map, const char * key, const char * value);
+
+// called with each key/value pair leaving a trashmap_cache_t
+typedef void (*trashmap_evict_fn)(void * ctx, const char * key, const char * value);
+
+// the current time for expiring cache items, in any unit as long as it never goes backwards
+typedef uint64_t (*trashmap_clock_fn)(void * ctx);
+
+typedef struct trashmap_cache_t {
+    // twice as many slots as `capacity`, a full cache stays at its peak load so misses must stay short.
+    // the map never rehashes, `map.count` is the number of live items
+    trashmap_t map;
+    // one byte per item, set when it is read and cleared as the CLOCK hand passes
+    unsigned char * referenced;
+    // hash of each item's key, so evicting it reads neither the key nor hashes it again
+    trashmap_hash_t * hashes;
+    size_t hand;
+    trashmap_evict_fn on_evict;
+    void * ctx;
+    size_t evictions;
+    // items[0, used) have been handed out, those expired since are on the free list with a NULL key
+    size_t used;
+    // only once trashmap_cache_set_clock was called: the deadline of each item, UINT64_MAX for none
+    uint64_t * expires;
+    trashmap_index_t * free_items;
+    size_t free_count;
+    trashmap_clock_fn clock;
+    void * clock_ctx;
+    // where the next trashmap_cache_sweep starts
+    size_t sweep;
+    size_t expirations;
+} trashmap_cache_t;
+
+// initialize an empty cache for up to `capacity` items, `on_evict` may be NULL.
+void trashmap_cache_init(trashmap_cache_t* cache, size_t capacity, trashmap_evict_fn on_evict, void * ctx);
+
+// hands every remaining pair to the eviction callback then releases all resources.
+void trashmap_cache_deinit(trashmap_cache_t* cache);
+
+// hands every pair to the eviction callback and empties the cache, keeping its memory.
+void trashmap_cache_clear(trashmap_cache_t* cache);
+
+// checks if the key appears in the cache and has not expired, without counting as a use.
+bool trashmap_cache_has(const trashmap_cache_t* cache, const char * key);
+
+// gets the associated value for the key and marks it as used, NULL if key does not appear in the cache.
+// an expired item is removed and handed to the eviction callback.
+const char* trashmap_cache_get(trashmap_cache_t* cache, const char * key);
+
+// inserts an element, evicting one if the cache is full, or replaces the key and value if it already exists.
+// the item never expires. does NOT duplicate strings.
+void trashmap_cache_set(trashmap_cache_t* cache, const char * key, const char * value);
+
+// enables expiry, `clock` is called with `ctx` whenever the cache needs the current time.
+void trashmap_cache_set_clock(trashmap_cache_t* cache, trashmap_clock_fn clock, void * ctx);
+
+// same as trashmap_cache_set but the item expires `ttl` clock units from now, requires a clock.
+void trashmap_cache_set_ttl(trashmap_cache_t* cache, const char * key, const char * value, uint64_t ttl);
+
+// checks at most `budget` items from where the last sweep stopped and removes the expired ones,
+// handing them to the eviction callback. returns how many were removed.
+size_t trashmap_cache_sweep(trashmap_cache_t* cache, size_t budget);
+
+typedef struct trashmap_pool_t {
+    // cleared maps ready to be handed out, the most recently released last
+    trashmap_t * idle;
+    size_t idle_count;
+    size_t idle_capacity;
+    size_t slot_count;
+    size_t slot_watermark;
+    size_t max_idle;
+} trashmap_pool_t;
+
+// initialize an empty pool handing out maps of `slot_count` slots, keeping up to `max_idle` of them.
+// released maps above `slot_watermark` slots are shrunk back to it.
+void trashmap_pool_init(trashmap_pool_t* pool, size_t slot_count, size_t slot_watermark, size_t max_idle);
+
+// releases every idle map, maps still acquired must be released or deinitialized separately.
+void trashmap_pool_deinit(trashmap_pool_t* pool);
+
+// initializes `map` as an empty map, reusing an idle one if there is one.
+void trashmap_pool_acquire(trashmap_pool_t* pool, trashmap_t* map);
+
+// clears `map` and keeps it for the next acquire, or deinitializes it once `max_idle` are kept.
+void trashmap_pool_release(trashmap_pool_t* pool, trashmap_t* map);
+
+// deinitializes idle maps until at most `keep` remain.
+void trashmap_pool_trim(trashmap_pool_t* pool, size_t keep);
 
 
 // to use an alternate allocator define: TRASHMAP_ALLOC(SIZE), TRASHMAP_REALLOC(PTR, SIZE) and TRASHMAP_FREE(PTR)
@@ -156,8 +858,17 @@ void trashmap_set(trashmap_t* map, const char * key, const char * value);
 #define TRASHMAP_ALLOC(SIZE) malloc(SIZE)
 #define TRASHMAP_REALLOC(PTR, SIZE) realloc(PTR, SIZE)
 #define TRASHMAP_FREE(PTR) free(PTR)
+#ifndef TRASHMAP_CALLOC
+#define TRASHMAP_CALLOC(COUNT, SIZE) calloc(COUNT, SIZE)
+#endif // TRASHMAP_CALLOC
 #endif // TRASHMAP_ALLOC
 
+// slot arrays are allocated zeroed, for an alternate allocator which can do that cheaply also define
+// TRASHMAP_CALLOC(COUNT, SIZE), otherwise TRASHMAP_ALLOC is followed by trashmap_memset
+#ifndef TRASHMAP_CALLOC
+#define TRASHMAP_CALLOC(COUNT, SIZE) trashmap_alloc_zeroed((COUNT) * (SIZE))
+#endif // TRASHMAP_CALLOC
+
 // to use a strip assets, use `-DTRASHMAP_STRIP_ASSERTS`
 #ifdef TRASHMAP_STRIP_ASSERTS
 #define TRASHMAP_ASSERT(COND)
@@ -176,20 +887,105 @@ void trashmap_set(trashmap_t* map, const char * key, const char * value);
 #define TRASHMAP_LITERAL(TYPE) (TYPE)
 #endif // __cplusplus
 
+// counters are updated through a cast, lookups take a const map but are still counted
+#ifdef TRASHMAP_COUNTERS
+#define TRASHMAP_COUNT(MAP, FIELD, N) (((trashmap_t*)(MAP))->counters.FIELD += (size_t)(N))
+#else
+#define TRASHMAP_COUNT(MAP, FIELD, N) ((void)0)
+#endif // TRASHMAP_COUNTERS
+
+// to trace resizes, define TRASHMAP_ON_RESIZE(MAP, OLD_SLOT_COUNT, NEW_SLOT_COUNT)
+#ifndef TRASHMAP_ON_RESIZE
+#define TRASHMAP_ON_RESIZE(MAP, OLD_SLOT_COUNT, NEW_SLOT_COUNT) ((void)0)
+#endif // TRASHMAP_ON_RESIZE
+
+// to trace lookups and inserts visiting at least TRASHMAP_LONG_PROBE slots, define TRASHMAP_ON_LONG_PROBE(MAP, KEY, PROBES)
+#ifndef TRASHMAP_ON_LONG_PROBE
+#define TRASHMAP_ON_LONG_PROBE(MAP, KEY, PROBES) ((void)0)
+#endif // TRASHMAP_ON_LONG_PROBE
+
+#ifndef TRASHMAP_LONG_PROBE
+#define TRASHMAP_LONG_PROBE 16
+#endif // TRASHMAP_LONG_PROBE
+
+// to run tasks in parallel, define TRASHMAP_PARALLEL_FOR(TASK, CTX, COUNT) which must call
+// TASK(CTX, i) for every i in [0, COUNT), and only return once every call has finished.
+// TASK has the signature void (*)(void * ctx, size_t i). by default tasks run one after another.
+#ifndef TRASHMAP_PARALLEL_FOR
+#define TRASHMAP_PARALLEL_FOR(TASK, CTX, COUNT) \
+    for (size_t trashmap_task_i = 0; trashmap_task_i < (COUNT); trashmap_task_i++) (TASK)((CTX), trashmap_task_i)
+// without a thread pool there is nothing to gain from splitting up a rehash
+#ifndef TRASHMAP_PARALLEL_REHASH_MIN
+#define TRASHMAP_PARALLEL_REHASH_MIN SIZE_MAX
+#endif // TRASHMAP_PARALLEL_REHASH_MIN
+#endif // TRASHMAP_PARALLEL_FOR
+
+// rehashes of maps with at least TRASHMAP_PARALLEL_REHASH_MIN slots are split into TRASHMAP_PARALLEL_REHASH_TASKS tasks
+#ifndef TRASHMAP_PARALLEL_REHASH_MIN
+#define TRASHMAP_PARALLEL_REHASH_MIN (1 << 16)
+#endif // TRASHMAP_PARALLEL_REHASH_MIN
+
+#ifndef TRASHMAP_PARALLEL_REHASH_TASKS
+#define TRASHMAP_PARALLEL_REHASH_TASKS 64
+#endif // TRASHMAP_PARALLEL_REHASH_TASKS
+
+// to use a custom busy wait hint, define TRASHMAP_SPIN_PAUSE()
+#ifndef TRASHMAP_SPIN_PAUSE
+#if defined(__x86_64__) || defined(__i386__)
+#define TRASHMAP_SPIN_PAUSE() __builtin_ia32_pause()
+#else
+#define TRASHMAP_SPIN_PAUSE()
+#endif
+#endif // TRASHMAP_SPIN_PAUSE
+
 #endif // TRASHMAP_H
 
 #ifdef TRASHMAP_IMPL
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#ifdef TRASHMAP_MMAP
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // TRASHMAP_MMAP
+
+// the readme documents TRASHMAP_CUSTOM_HASH, accept it as well
+#if defined(TRASHMAP_CUSTOM_HASH) && !defined(TRASHMAP_CUSTOM_HASH_FUNCTION)
+#define TRASHMAP_CUSTOM_HASH_FUNCTION
+#endif
+
+#ifdef TRASHMAP_64BIT
+#define FNV_1A_OFFSET_BASIS 14695981039346656037ull
+
+static inline trashmap_hash_t trashmap_fnv_1a_step(trashmap_hash_t hash, unsigned char byte) {
+    return (hash ^ byte) * 1099511628211ull;
+}
+#else
+#define FNV_1A_OFFSET_BASIS 2166136261u
+
+static inline trashmap_hash_t trashmap_fnv_1a_step(trashmap_hash_t hash, unsigned char byte) {
+    hash = hash ^ byte;
+    // equivalent to hash = hash * 16777619
+    return hash + (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
+}
+#endif // TRASHMAP_64BIT
+
 #ifndef TRASHMAP_CUSTOM_HASH_FUNCTION
-uint32_t trashmap_hash(const char * key) {
+trashmap_hash_t trashmap_hash(const char * key) {
     // implementation of the FNV-1a algorithm
     const unsigned char * str = (const unsigned char *)key;
-    #define FNV_1A_OFFSET_BASIS 2166136261
-    uint32_t hash = FNV_1A_OFFSET_BASIS;
+    trashmap_hash_t hash = FNV_1A_OFFSET_BASIS;
     while (*str) {
-        hash = hash ^ *(str++);
-        // equivalent to hash = hash * 16777619
-        hash = hash + (hash << 1) + (hash << 4) + (hash << 7) + (hash << 8) + (hash << 24);
+        hash = trashmap_fnv_1a_step(hash, *(str++));
     }
     return hash;
 }
@@ -203,73 +999,606 @@ int trashmap_strcmp(const char * lhs, const char * rhs) {
     return *rhs - *lhs;
 }
 
+// vector loads may read past the nul terminator, which can't fault as long as they stay within a page,
+// but address sanitizer still reports it, so the comparisons below opt out of its checks.
+#if defined(__SANITIZE_ADDRESS__)
+#define TRASHMAP_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define TRASHMAP_NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef TRASHMAP_NO_SANITIZE_ADDRESS
+#define TRASHMAP_NO_SANITIZE_ADDRESS
+#endif
+
+// the smallest page size of the target, over-reading loads never cross a multiple of it
+#ifndef TRASHMAP_PAGE_SIZE
+#define TRASHMAP_PAGE_SIZE 4096
+#endif // TRASHMAP_PAGE_SIZE
+
+#if defined(__AVX2__)
+#define TRASHMAP_STREQ_WIDTH 32
+#elif defined(__SSE2__) || (defined(__aarch64__) && defined(__ARM_NEON))
+#define TRASHMAP_STREQ_WIDTH 16
+#endif
+
+// equality of two nul terminated strings a vector at a time, for the probe loops.
+// while either string is close to the end of a page it falls back to a byte at a time until both are past it.
+TRASHMAP_NO_SANITIZE_ADDRESS
+static inline bool trashmap_streq(const char * lhs, const char * rhs) {
+#ifdef TRASHMAP_STREQ_WIDTH
+    const uintptr_t last_safe = TRASHMAP_PAGE_SIZE - TRASHMAP_STREQ_WIDTH;
+    for (;;) {
+        if (((uintptr_t)lhs & (TRASHMAP_PAGE_SIZE - 1)) > last_safe || ((uintptr_t)rhs & (TRASHMAP_PAGE_SIZE - 1)) > last_safe) {
+            if (*lhs != *rhs) return false;
+            if (!*lhs) return true;
+            lhs++, rhs++;
+            continue;
+        }
+#if defined(__AVX2__)
+        __m256i l = _mm256_loadu_si256((const __m256i*)lhs), r = _mm256_loadu_si256((const __m256i*)rhs);
+        // bytes that differ or end lhs, the first one decides
+        unsigned mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, r))
+            | (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(l, _mm256_setzero_si256()));
+        if (mask) {
+            unsigned first = (unsigned)__builtin_ctz(mask);
+            return lhs[first] == rhs[first];
+        }
+#elif defined(__SSE2__)
+        __m128i l = _mm_loadu_si128((const __m128i*)lhs), r = _mm_loadu_si128((const __m128i*)rhs);
+        // bytes that differ or end lhs, the first one decides
+        unsigned mask = (~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(l, r)) & 0xffffu)
+            | (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(l, _mm_setzero_si128()));
+        if (mask) {
+            unsigned first = (unsigned)__builtin_ctz(mask);
+            return lhs[first] == rhs[first];
+        }
+#else
+        uint8x16_t l = vld1q_u8((const uint8_t*)lhs), r = vld1q_u8((const uint8_t*)rhs);
+        // neon has no movemask, once a chunk differs or ends the scalar loop finds where within it
+        if (vmaxvq_u8(vorrq_u8(vmvnq_u8(vceqq_u8(l, r)), vceqzq_u8(l)))) {
+            while (*lhs == *rhs && *lhs) lhs++, rhs++;
+            return *lhs == *rhs;
+        }
+#endif
+        lhs += TRASHMAP_STREQ_WIDTH;
+        rhs += TRASHMAP_STREQ_WIDTH;
+    }
+#else
+    while (*lhs == *rhs && *lhs) lhs++, rhs++;
+    return *lhs == *rhs;
+#endif // TRASHMAP_STREQ_WIDTH
+}
+
+// equality of two byte ranges of known length a vector at a time, never reads past either range.
+// keys whose lengths are known from their slot tags are compared with it.
+static inline bool trashmap_memeq(const void * lhs, const void * rhs, size_t count) {
+    const unsigned char * l = (const unsigned char *)lhs;
+    const unsigned char * r = (const unsigned char *)rhs;
+    size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 32 <= count; i += 32) {
+        __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)(l + i)), _mm256_loadu_si256((const __m256i*)(r + i)));
+        if ((unsigned)_mm256_movemask_epi8(eq) != 0xffffffffu) return false;
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= count; i += 16) {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(l + i)), _mm_loadu_si128((const __m128i*)(r + i)));
+        if (_mm_movemask_epi8(eq) != 0xffff) return false;
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    for (; i + 16 <= count; i += 16) {
+        if (vminvq_u8(vceqq_u8(vld1q_u8(l + i), vld1q_u8(r + i))) == 0) return false;
+    }
+#endif
+    for (; i < count; i++) {
+        if (l[i] != r[i]) return false;
+    }
+    return true;
+}
+
 void * trashmap_memset(void * dest, unsigned char byte, size_t count) {
     unsigned char * d = (unsigned char *)dest;
-    for (size_t i = 0; i < count; i++) {
+    size_t i = 0;
+    // clearing slot arrays is most of the cost of trashmap_clear, so store a vector at a time
+#if defined(__AVX2__)
+    __m256i wide = _mm256_set1_epi8((char)byte);
+    for (; i + 32 <= count; i += 32) _mm256_storeu_si256((__m256i*)(d + i), wide);
+#endif
+#if defined(__SSE2__)
+    __m128i vec = _mm_set1_epi8((char)byte);
+    for (; i + 16 <= count; i += 16) _mm_storeu_si128((__m128i*)(d + i), vec);
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    uint8x16_t vec = vdupq_n_u8(byte);
+    for (; i + 16 <= count; i += 16) vst1q_u8(d + i, vec);
+#endif
+    for (; i < count; i++) {
         d[i] = byte;
     }
     return dest;
 }
 
+static inline void * trashmap_alloc_zeroed(size_t size) {
+    void * ptr = TRASHMAP_ALLOC(size);
+    return ptr ? trashmap_memset(ptr, 0, size) : ptr;
+}
+
+// zeroed slots are empty, so fresh slot arrays come straight from TRASHMAP_CALLOC
+static inline trashmap_slot_t* trashmap_alloc_slots(size_t count) {
+    trashmap_slot_t* slots = (trashmap_slot_t*)TRASHMAP_CALLOC(count, sizeof(trashmap_slot_t));
+    TRASHMAP_ASSERT(slots && "out of memory");
+    return slots;
+}
+
+#ifdef TRASHMAP_FILTER
+// about 21 bits per item at the 75% load limit. the block index is taken from 32 bits of the hash, hence the cap
+static inline size_t trashmap_filter_blocks(size_t slot_count) {
+    size_t blocks = slot_count / 16 + 1;
+    return blocks < UINT32_MAX ? blocks : UINT32_MAX;
+}
+
+// replaces the filter with an empty one sized for `slot_count` slots
+static inline void trashmap_filter_alloc(trashmap_t* map, size_t slot_count) {
+    if (map->filter_alloc) TRASHMAP_FREE(map->filter_alloc);
+    map->filter_blocks = trashmap_filter_blocks(slot_count);
+    // one spare block to align the blocks to their size, so none straddles a cache line
+    map->filter_alloc = TRASHMAP_CALLOC(map->filter_blocks + 1, sizeof(trashmap_filter_block_t));
+    TRASHMAP_ASSERT(map->filter_alloc && "out of memory");
+    uintptr_t aligned = ((uintptr_t)map->filter_alloc + sizeof(trashmap_filter_block_t) - 1) & ~(uintptr_t)(sizeof(trashmap_filter_block_t) - 1);
+    map->filter = (trashmap_filter_block_t*)aligned;
+}
+
+// salts of the split block bloom filter from the Parquet format, each picks one bit of its word
+static const uint32_t trashmap_filter_salts[8] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du, 0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u,
+};
+
+// spreads the hash over 64 bits, the high half picks the block and the low half the bits within it
+static inline uint64_t trashmap_filter_mix(trashmap_hash_t hash) {
+    return (uint64_t)hash * 0x9e3779b97f4a7c15ull;
+}
+
+static inline trashmap_filter_block_t* trashmap_filter_block(const trashmap_t* map, uint64_t mixed) {
+    return &map->filter[((mixed >> 32) * map->filter_blocks) >> 32];
+}
+
+static inline void trashmap_filter_add(trashmap_t* map, trashmap_hash_t hash) {
+    uint64_t mixed = trashmap_filter_mix(hash);
+    trashmap_filter_block_t* block = trashmap_filter_block(map, mixed);
+    for (size_t i = 0; i < 8; i++) {
+        block->words[i] |= 1u << (((uint32_t)mixed * trashmap_filter_salts[i]) >> 27);
+    }
+}
+
+// false only if no key with this hash was added
+static inline bool trashmap_filter_may_have(const trashmap_t* map, trashmap_hash_t hash) {
+    uint64_t mixed = trashmap_filter_mix(hash);
+    const trashmap_filter_block_t* block = trashmap_filter_block(map, mixed);
+#if defined(__AVX2__)
+    __m256i salts = _mm256_loadu_si256((const __m256i*)trashmap_filter_salts);
+    __m256i shifts = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32((int)(uint32_t)mixed), salts), 27);
+    __m256i bits = _mm256_sllv_epi32(_mm256_set1_epi32(1), shifts);
+    // every bit set in the block
+    return _mm256_testc_si256(_mm256_load_si256((const __m256i*)block->words), bits);
+#else
+    uint32_t missing = 0;
+    for (size_t i = 0; i < 8; i++) {
+        missing |= ~block->words[i] & (1u << (((uint32_t)mixed * trashmap_filter_salts[i]) >> 27));
+    }
+    return missing == 0;
+#endif
+}
+#endif // TRASHMAP_FILTER
+
 void trashmap_init(trashmap_t* map, size_t count) {
     TRASHMAP_ASSERT(count && "hash map must have at least 1 slot to start");
-    size_t length = count * sizeof(*map->slots);
-    map->slots = (trashmap_slot_t*)trashmap_memset(TRASHMAP_ALLOC(length), 0xFF, length);
-    TRASHMAP_ASSERT(map->slots && "out of memory");
+    map->slots = trashmap_alloc_slots(count);
     map->slot_count = count;
     map->items = NULL;
     map->count = 0;
     map->capacity = 0;
+#ifdef TRASHMAP_FILTER
+    map->filter_alloc = NULL;
+    trashmap_filter_alloc(map, count);
+#endif // TRASHMAP_FILTER
+#ifdef TRASHMAP_STATS
+    map->rehash_count = 0;
+#endif // TRASHMAP_STATS
+#ifdef TRASHMAP_COUNTERS
+    trashmap_memset(&map->counters, 0, sizeof(map->counters));
+#endif // TRASHMAP_COUNTERS
 }
 
 void trashmap_deinit(trashmap_t* map) {
     if (map->slots) TRASHMAP_FREE(map->slots);
     if (map->items) TRASHMAP_FREE(map->items);
+#ifdef TRASHMAP_FILTER
+    if (map->filter_alloc) TRASHMAP_FREE(map->filter_alloc);
+#endif // TRASHMAP_FILTER
 }
 
 void trashmap_clear(trashmap_t* map) {
     map->count = 0;
-    trashmap_memset(map->slots, 0xFF, map->slot_count * sizeof(*map->slots));
+    trashmap_memset(map->slots, 0, map->slot_count * sizeof(*map->slots));
+#ifdef TRASHMAP_FILTER
+    trashmap_memset(map->filter, 0, map->filter_blocks * sizeof(*map->filter));
+#endif // TRASHMAP_FILTER
 }
 
-const char* trashmap_get(const trashmap_t* map, const char * key) {
-    uint32_t hash = trashmap_hash(key);
-    uint32_t start = hash % map->slot_count;
-    uint32_t idx = start;
-    do {
-        uint32_t bhash = map->slots[idx].hash;
-        uint32_t bidx = map->slots[idx].index;
-        if (bidx == UINT32_MAX) {
-            return NULL;
-        }
-        if (bhash == hash && trashmap_strcmp(key, map->items[bidx].key) == 0) {
-            return map->items[map->slots[idx].index].value;
-        }
-        idx = (idx + 1) % map->slot_count;
-    } while (idx != start);
-    return NULL;
+#ifdef TRASHMAP_SLOT_PREFIX
+static inline uint64_t trashmap_key_tag(const char * key) {
+    uint64_t tag = 0;
+    size_t len = 0;
+    for (; len < 6 && key[len]; len++) {
+        tag |= (uint64_t)(unsigned char)key[len] << (16 + 8 * len);
+    }
+    while (key[len]) len++;
+    return tag | (len < UINT16_MAX ? len : UINT16_MAX);
 }
 
-bool trashmap_has(const trashmap_t* map, const char * key) {
-    uint32_t hash = trashmap_hash(key);
-    uint32_t start = hash % map->slot_count;
-    uint32_t idx = start;
-    do {
-        uint32_t bhash = map->slots[idx].hash;
-        uint32_t bidx = map->slots[idx].index;
-        if (bidx == UINT32_MAX) {
-            return false;
-        }
-        if (bhash == hash && trashmap_strcmp(key, map->items[bidx].key) == 0) {
-            return true;
-        }
+// true when the tag holds the whole key, so a matching tag is a matching key
+static inline bool trashmap_tag_is_key(uint64_t tag) {
+    return (tag & 0xffff) <= 6;
+}
+
+// equality of `key` and the stored key once their tags match and the tag doesn't hold the whole key.
+// both lengths are known from the tag, so only the bytes past the prefix are compared, unless the length saturated
+static inline bool trashmap_tag_key_eq(uint64_t tag, const char * key, const char * stored) {
+    size_t len = (size_t)(tag & 0xffff);
+    if (len == UINT16_MAX) return trashmap_streq(key, stored);
+    return trashmap_memeq(key + 6, stored + 6, len - 6);
+}
+#else
+static inline uint64_t trashmap_key_tag(const char * key) {
+    (void)key;
+    return 0;
+}
+
+static inline bool trashmap_tag_is_key(uint64_t tag) {
+    (void)tag;
+    return false;
+}
+
+static inline bool trashmap_tag_key_eq(uint64_t tag, const char * key, const char * stored) {
+    (void)tag;
+    return trashmap_streq(key, stored);
+}
+#endif // TRASHMAP_SLOT_PREFIX
+
+// the part of the hash kept in a slot
+static inline trashmap_hash_t trashmap_hash_fragment(trashmap_hash_t hash) {
+#ifdef TRASHMAP_COMPACT_SLOTS
+    return hash >> 16;
+#else
+    return hash;
+#endif // TRASHMAP_COMPACT_SLOTS
+}
+
+static inline trashmap_slot_t trashmap_make_slot(trashmap_hash_t hash, trashmap_index_t index, uint64_t tag) {
+    trashmap_slot_t slot;
+#ifdef TRASHMAP_COMPACT_SLOTS
+    slot.hash = (uint16_t)trashmap_hash_fragment(hash);
+    slot.index = (uint16_t)index;
+#else
+    slot.hash = hash;
+    slot.index = index;
+#endif // TRASHMAP_COMPACT_SLOTS
+#ifdef TRASHMAP_SLOT_PREFIX
+    slot.tag = tag;
+#else
+    (void)tag;
+#endif // TRASHMAP_SLOT_PREFIX
+    return slot;
+}
+
+// whether an occupied slot may hold `key`, decided from the slot alone. the key's tag is only needed once
+// a hash matches, so it is computed then and cached in `tag`, which the caller starts at UINT64_MAX.
+static inline bool trashmap_slot_may_hold(const trashmap_slot_t* slot, trashmap_hash_t hash, const char * key, uint64_t* tag) {
+    if (slot->hash != trashmap_hash_fragment(hash)) return false;
+#ifdef TRASHMAP_SLOT_PREFIX
+    if (*tag == UINT64_MAX) *tag = trashmap_key_tag(key);
+    return slot->tag == *tag;
+#else
+    (void)key;
+    (void)tag;
+    return true;
+#endif // TRASHMAP_SLOT_PREFIX
+}
+
+// counts the probes of one lookup and fires TRASHMAP_ON_LONG_PROBE
+static inline void trashmap_probe_end(const trashmap_t* map, const char * key, size_t probes) {
+    TRASHMAP_COUNT(map, probes, probes);
+    if (probes >= TRASHMAP_LONG_PROBE) {
+        TRASHMAP_ON_LONG_PROBE(map, key, probes);
+    }
+    (void)map;
+    (void)key;
+}
+
+// finds the slot holding `key`, or the empty slot it would be inserted into.
+// returns `map->slot_count` if the key is missing and there are no empty slots.
+static inline size_t trashmap_probe(const trashmap_t* map, const char * key, trashmap_hash_t hash) {
+    size_t start = hash % map->slot_count;
+    size_t idx = start;
+    size_t probes = 0;
+    uint64_t tag = UINT64_MAX;
+    do {
+        probes += 1;
+        trashmap_index_t bidx = map->slots[idx].index;
+        if (bidx == 0) {
+            trashmap_probe_end(map, key, probes);
+            return idx;
+        }
+        if (trashmap_slot_may_hold(&map->slots[idx], hash, key, &tag)) {
+            if (trashmap_tag_is_key(tag)) {
+                trashmap_probe_end(map, key, probes);
+                return idx;
+            }
+            TRASHMAP_COUNT(map, strcmps, 1);
+            if (trashmap_tag_key_eq(tag, key, map->items[bidx - 1].key)) {
+                trashmap_probe_end(map, key, probes);
+                return idx;
+            }
+        }
         idx = (idx + 1) % map->slot_count;
     } while (idx != start);
-    return false;
+    trashmap_probe_end(map, key, probes);
+    return map->slot_count;
+}
+
+static inline const char* trashmap_get_hashed(const trashmap_t* map, const char * key, trashmap_hash_t hash) {
+#ifdef TRASHMAP_FILTER
+    if (!trashmap_filter_may_have(map, hash)) {
+        TRASHMAP_COUNT(map, gets, 1);
+        TRASHMAP_COUNT(map, misses, 1);
+        TRASHMAP_COUNT(map, filtered, 1);
+        return NULL;
+    }
+#endif // TRASHMAP_FILTER
+    size_t idx = trashmap_probe(map, key, hash);
+    TRASHMAP_COUNT(map, gets, 1);
+    if (idx == map->slot_count || map->slots[idx].index == 0) {
+        TRASHMAP_COUNT(map, misses, 1);
+        return NULL;
+    }
+    TRASHMAP_COUNT(map, hits, 1);
+    return map->items[map->slots[idx].index - 1].value;
+}
+
+static inline bool trashmap_has_hashed(const trashmap_t* map, const char * key, trashmap_hash_t hash) {
+#ifdef TRASHMAP_FILTER
+    if (!trashmap_filter_may_have(map, hash)) {
+        TRASHMAP_COUNT(map, gets, 1);
+        TRASHMAP_COUNT(map, misses, 1);
+        TRASHMAP_COUNT(map, filtered, 1);
+        return false;
+    }
+#endif // TRASHMAP_FILTER
+    size_t idx = trashmap_probe(map, key, hash);
+    bool found = idx != map->slot_count && map->slots[idx].index != 0;
+    TRASHMAP_COUNT(map, gets, 1);
+    TRASHMAP_COUNT(map, hits, found);
+    TRASHMAP_COUNT(map, misses, !found);
+    return found;
 }
 
+const char* trashmap_get(const trashmap_t* map, const char * key) {
+    return trashmap_get_hashed(map, key, trashmap_hash(key));
+}
+
+bool trashmap_has(const trashmap_t* map, const char * key) {
+    return trashmap_has_hashed(map, key, trashmap_hash(key));
+}
 
-void trashmap_reserve(trashmap_t* map, size_t extra) {
+// the full hash of the key in an occupied slot
+static inline trashmap_hash_t trashmap_slot_hash(const trashmap_t* map, trashmap_slot_t slot) {
+#ifdef TRASHMAP_COMPACT_SLOTS
+    return trashmap_hash(map->items[slot.index - 1].key);
+#else
+    (void)map;
+    return slot.hash;
+#endif // TRASHMAP_COMPACT_SLOTS
+}
+
+// places an occupied slot with the given full hash at the first empty slot from its home,
+// the key must not already be present.
+static inline void trashmap_place_slot(trashmap_slot_t* slots, size_t slot_count, trashmap_slot_t slot, trashmap_hash_t hash) {
+    size_t start = hash % slot_count;
+    size_t idx = start;
+    do {
+        if (slots[idx].index == 0) {
+            slots[idx] = slot;
+            return;
+        }
+        idx = (idx + 1) % slot_count;
+    } while (idx != start);
+    TRASHMAP_ASSERT(0 && "corrupted hash map");
+}
+
+// empties the slot at `idx` by shifting later slots of its cluster back over it, so no probe stops early.
+// a slot may move into the hole as long as the hole is not before its home.
+static inline void trashmap_remove_slot(trashmap_t* map, size_t idx) {
+    size_t slot_count = map->slot_count;
+    size_t hole = idx;
+    size_t next = idx + 1 < slot_count ? idx + 1 : 0;
+    while (map->slots[next].index != 0) {
+        size_t home = trashmap_slot_hash(map, map->slots[next]) % slot_count;
+        size_t from_home = next >= home ? next - home : next + slot_count - home;
+        size_t from_hole = next >= hole ? next - hole : next + slot_count - hole;
+        if (from_home >= from_hole) {
+            map->slots[hole] = map->slots[next];
+            hole = next;
+        }
+        next = next + 1 < slot_count ? next + 1 : 0;
+    }
+    map->slots[hole] = trashmap_make_slot(0, 0, 0);
+}
+
+#ifdef TRASHMAP_FILTER
+// refills the filter from the slot table, after it was resized
+static inline void trashmap_filter_rebuild(trashmap_t* map) {
+    for (size_t idx = 0; idx < map->slot_count; idx++) {
+        if (map->slots[idx].index == 0) continue;
+        trashmap_filter_add(map, trashmap_slot_hash(map, map->slots[idx]));
+    }
+}
+#endif // TRASHMAP_FILTER
+
+typedef struct trashmap_rehash_ctx_t {
+    const trashmap_t* map;
+    trashmap_slot_t* new_slots;
+    size_t new_slot_count;
+    size_t chunk;
+    // slots which probed off the end of their destination range, appended atomically
+    trashmap_slot_t* overflow;
+    size_t overflow_count;
+} trashmap_rehash_ctx_t;
+
+// moves every slot whose old home is in [lo, hi) of the old array. since the new slot count is a multiple
+// of the old one, their new homes all lie in the ranges [k * old + lo, k * old + hi), which no other task writes.
+static void trashmap_rehash_task(void * ctx, size_t task) {
+    trashmap_rehash_ctx_t* rehash = (trashmap_rehash_ctx_t*)ctx;
+    const trashmap_t* map = rehash->map;
+    size_t lo = task * rehash->chunk;
+    size_t hi = lo + rehash->chunk < map->slot_count ? lo + rehash->chunk : map->slot_count;
+    // slots homed in [lo, hi) sit between lo and the first empty slot at or after hi, possibly wrapping around
+    size_t idx = lo;
+    for (size_t scanned = 0; scanned < map->slot_count; scanned++, idx = (idx + 1) % map->slot_count) {
+        trashmap_slot_t slot = map->slots[idx];
+        if (slot.index == 0) {
+            if (scanned >= hi - lo) break;
+            continue;
+        }
+        trashmap_hash_t hash = trashmap_slot_hash(map, slot);
+        size_t old_home = hash % map->slot_count;
+        if (old_home < lo || old_home >= hi) continue;
+        size_t new_idx = hash % rehash->new_slot_count;
+        size_t end = new_idx - old_home + hi;
+        for (; new_idx < end; new_idx++) {
+            if (rehash->new_slots[new_idx].index == 0) {
+                rehash->new_slots[new_idx] = slot;
+                break;
+            }
+        }
+        if (new_idx == end) {
+            rehash->overflow[__atomic_fetch_add(&rehash->overflow_count, 1, __ATOMIC_RELAXED)] = slot;
+        }
+    }
+}
+
+// frees the slot array and takes `new_slots` in its place, resizing and refilling the filter to match.
+static inline void trashmap_replace_slots(trashmap_t* map, trashmap_slot_t* new_slots, size_t new_slot_count) {
+    TRASHMAP_FREE(map->slots);
+
+    size_t old_slot_count = map->slot_count;
+    map->slots = new_slots;
+    map->slot_count = new_slot_count;
+#ifdef TRASHMAP_FILTER
+    trashmap_filter_alloc(map, new_slot_count);
+    trashmap_filter_rebuild(map);
+#endif // TRASHMAP_FILTER
+#ifdef TRASHMAP_STATS
+    map->rehash_count += 1;
+#endif // TRASHMAP_STATS
+    TRASHMAP_COUNT(map, resizes, 1);
+    TRASHMAP_ON_RESIZE(map, old_slot_count, new_slot_count);
+    (void)old_slot_count;
+}
+
+// moves all slots into a new slot array of `new_slot_count` slots.
+static void trashmap_rehash(trashmap_t* map, size_t new_slot_count) {
+    trashmap_slot_t* new_slots = trashmap_alloc_slots(new_slot_count);
+
+    if (map->slot_count >= TRASHMAP_PARALLEL_REHASH_MIN && new_slot_count % map->slot_count == 0) {
+        trashmap_rehash_ctx_t rehash;
+        rehash.map = map;
+        rehash.new_slots = new_slots;
+        rehash.new_slot_count = new_slot_count;
+        rehash.chunk = (map->slot_count + TRASHMAP_PARALLEL_REHASH_TASKS - 1) / TRASHMAP_PARALLEL_REHASH_TASKS;
+        rehash.overflow = (trashmap_slot_t*)TRASHMAP_ALLOC((map->count + 1) * sizeof(trashmap_slot_t));
+        TRASHMAP_ASSERT(rehash.overflow && "out of memory");
+        rehash.overflow_count = 0;
+        size_t tasks = (map->slot_count + rehash.chunk - 1) / rehash.chunk;
+        TRASHMAP_PARALLEL_FOR(trashmap_rehash_task, &rehash, tasks);
+        for (size_t i = 0; i < rehash.overflow_count; i++) {
+            trashmap_place_slot(new_slots, new_slot_count, rehash.overflow[i], trashmap_slot_hash(map, rehash.overflow[i]));
+        }
+        TRASHMAP_FREE(rehash.overflow);
+    } else {
+        for (size_t map_idx = 0; map_idx < map->slot_count; map_idx++) {
+            if (map->slots[map_idx].index == 0) continue;
+            trashmap_place_slot(new_slots, new_slot_count, map->slots[map_idx], trashmap_slot_hash(map, map->slots[map_idx]));
+        }
+    }
+
+    trashmap_replace_slots(map, new_slots, new_slot_count);
+}
+
+trashmap_memory_t trashmap_memory_usage(const trashmap_t* map) {
+    trashmap_memory_t usage;
+    usage.slots = map->slot_count * sizeof(*map->slots);
+    usage.items = map->capacity * sizeof(*map->items);
+    usage.unused_items = (map->capacity - map->count) * sizeof(*map->items);
+#ifdef TRASHMAP_FILTER
+    usage.filter = (map->filter_blocks + 1) * sizeof(*map->filter);
+#else
+    usage.filter = 0;
+#endif // TRASHMAP_FILTER
+    usage.total = usage.slots + usage.items + usage.filter;
+    return usage;
+}
+
+#ifdef TRASHMAP_STATS
+void trashmap_stats(const trashmap_t* map, trashmap_stats_t* out) {
+    trashmap_memset(out, 0, sizeof(*out));
+    out->count = map->count;
+    out->slot_count = map->slot_count;
+    out->load_factor = (double)map->count / (double)map->slot_count;
+    out->rehash_count = map->rehash_count;
+    out->bytes_allocated = trashmap_memory_usage(map).total;
+
+    size_t total_displacement = 0;
+    size_t run = 0;
+    // start just after an empty slot so clusters wrapping past the end are counted once
+    size_t first = 0;
+    while (first < map->slot_count && map->slots[first].index != 0) first++;
+    for (size_t n = 1; n <= map->slot_count; n++) {
+        size_t idx = (first + n) % map->slot_count;
+        trashmap_slot_t slot = map->slots[idx];
+        if (slot.index == 0) {
+            run = 0;
+            continue;
+        }
+        if (run == 0) out->clusters += 1;
+        run += 1;
+        if (run > out->max_cluster) out->max_cluster = run;
+
+        size_t home = trashmap_slot_hash(map, slot) % map->slot_count;
+        size_t displacement = (idx + map->slot_count - home) % map->slot_count;
+        total_displacement += displacement;
+        if (displacement > out->max_displacement) out->max_displacement = displacement;
+        out->probe_histogram[displacement < TRASHMAP_PROBE_HISTOGRAM_SIZE ? displacement : TRASHMAP_PROBE_HISTOGRAM_SIZE - 1] += 1;
+
+        // an item with the same hash shares the home slot, so is somewhere between home and here.
+        // compact slots only compare the stored part of the hash
+        for (size_t prev = home; prev != idx; prev = (prev + 1) % map->slot_count) {
+            if (map->slots[prev].hash == slot.hash) {
+                out->hash_collisions += 1;
+                break;
+            }
+        }
+    }
+    out->mean_displacement = map->count ? (double)total_displacement / (double)map->count : 0.0;
+}
+#endif // TRASHMAP_STATS
+
+bool trashmap_reserve(trashmap_t* map, size_t extra) {
+    // not an assert, past this the slot index would silently truncate
+    if (extra > TRASHMAP_MAX_ITEMS - map->count) {
+        return false;
+    }
     if (map->count + extra > map->capacity) {
         if (map->capacity == 0) {
             map->capacity = 16;
@@ -282,58 +1611,1338 @@ void trashmap_reserve(trashmap_t* map, size_t extra) {
     }
     // ensure load factor is not more than 75%
     if (map->count + extra > map->slot_count * 3 / 4) {
-
-        // expands slots and copies all old slots into new spaces
         size_t new_slot_count = map->slot_count * 2;
-        size_t length = new_slot_count * sizeof(trashmap_slot_t);
+        while (map->count + extra > new_slot_count * 3 / 4) {
+            new_slot_count *= 2;
+        }
+        trashmap_rehash(map, new_slot_count);
+    }
+    return true;
+}
+
+// reallocates the items to hold exactly `capacity`, which must be at least `count`
+static inline void trashmap_resize_items(trashmap_t* map, size_t capacity) {
+    if (capacity == 0) {
+        if (map->items) TRASHMAP_FREE(map->items);
+        map->items = NULL;
+    } else {
+        map->items = (trashmap_item_t*)TRASHMAP_REALLOC(map->items, capacity * sizeof(*map->items));
+        TRASHMAP_ASSERT(map->items && "out of memory");
+    }
+    map->capacity = capacity;
+}
 
-        trashmap_slot_t* new_slots = (trashmap_slot_t*)trashmap_memset(TRASHMAP_ALLOC(length), 0xFF, length);
-        TRASHMAP_ASSERT(new_slots && "out of memory");
+void trashmap_shrink_to_fit(trashmap_t* map) {
+    // halving undoes the doublings of trashmap_reserve, so a later regrowth lands on the same sizes
+    size_t new_slot_count = map->slot_count;
+    while (new_slot_count > 1 && map->count <= new_slot_count / 2 * 3 / 4) {
+        new_slot_count /= 2;
+    }
+    if (new_slot_count != map->slot_count) trashmap_rehash(map, new_slot_count);
+    if (map->capacity != map->count) trashmap_resize_items(map, map->count);
+}
 
-        for (size_t map_idx = 0; map_idx < map->slot_count; map_idx++) {
-            if (map->slots[map_idx].index == UINT32_MAX) continue;
-            uint32_t start = map->slots[map_idx].hash % new_slot_count;
-            uint32_t new_idx = start;
-            do {
-                if (new_slots[new_idx].index == UINT32_MAX) {
-                    new_slots[new_idx] = map->slots[map_idx];
-                    break;
-                }
-                new_idx = (new_idx + 1) % new_slot_count;
-            } while (new_idx != start);
+void trashmap_clear_shrink(trashmap_t* map, size_t slot_watermark) {
+    TRASHMAP_ASSERT(slot_watermark && "hash map must keep at least 1 slot");
+    if (map->slot_count <= slot_watermark) {
+        trashmap_clear(map);
+        return;
+    }
+    map->count = 0;
+    // a fresh zeroed table is cheaper than clearing the large one
+    trashmap_replace_slots(map, trashmap_alloc_slots(slot_watermark), slot_watermark);
+    if (map->capacity > slot_watermark * 3 / 4) trashmap_resize_items(map, slot_watermark * 3 / 4);
+}
+
+// inserts or updates at `idx` as returned by trashmap_probe, the caller must ensure there is space for one more item.
+static inline void trashmap_insert_at(trashmap_t* map, size_t idx, const char * key, const char * value, trashmap_hash_t hash) {
+    TRASHMAP_ASSERT(idx != map->slot_count && "corrupted hash map");
+    TRASHMAP_COUNT(map, sets, 1);
+
+    trashmap_index_t item_idx = map->slots[idx].index;
+    if (item_idx == 0) {
+        map->items[map->count] = TRASHMAP_LITERAL(trashmap_item_t){.key = key, .value = value};
+        map->count += 1;
+        map->slots[idx] = trashmap_make_slot(hash, (trashmap_index_t)map->count, trashmap_key_tag(key));
+#ifdef TRASHMAP_FILTER
+        trashmap_filter_add(map, hash);
+#endif // TRASHMAP_FILTER
+    } else {
+        TRASHMAP_COUNT(map, overwrites, 1);
+        map->items[item_idx - 1].value = value;
+    }
+}
+
+// inserts or updates without reserving, the caller must ensure there is space for one more item.
+static inline void trashmap_insert_hashed(trashmap_t* map, const char * key, const char * value, trashmap_hash_t hash) {
+    trashmap_insert_at(map, trashmap_probe(map, key, hash), key, value, hash);
+}
+
+static inline bool trashmap_set_hashed(trashmap_t* map, const char * key, const char * value, trashmap_hash_t hash) {
+    if (!trashmap_reserve(map, 1)) {
+        // a full map can still update a key it already holds
+        size_t idx = trashmap_probe(map, key, hash);
+        if (idx == map->slot_count || map->slots[idx].index == 0) {
+            return false;
         }
+        trashmap_insert_at(map, idx, key, value, hash);
+        return true;
+    }
+    trashmap_insert_hashed(map, key, value, hash);
+    return true;
+}
+
+bool trashmap_set(trashmap_t* map, const char * key, const char * value) {
+    return trashmap_set_hashed(map, key, value, trashmap_hash(key));
+}
+
+typedef struct trashmap_build_ctx_t {
+    trashmap_t* map;
+    const trashmap_item_t * pairs;
+    size_t count;
+    trashmap_hash_t * hashes;
+    // pair indices grouped by partition, partition p owns order[offsets[p] .. offsets[p + 1])
+    trashmap_index_t * order;
+    size_t * offsets;
+    // pairs which probed off the end of their partition, stored in the same layout as order
+    trashmap_index_t * overflow;
+    size_t * overflow_counts;
+    size_t * placed_counts;
+    // where each partition's items end up once compacted
+    size_t * dest;
+    size_t partitions;
+    size_t chunk;
+} trashmap_build_ctx_t;
 
+static void trashmap_build_hash_task(void * ctx, size_t task) {
+    trashmap_build_ctx_t* build = (trashmap_build_ctx_t*)ctx;
+    size_t per_task = (build->count + build->partitions - 1) / build->partitions;
+    size_t end = (task + 1) * per_task < build->count ? (task + 1) * per_task : build->count;
+    for (size_t i = task * per_task; i < end; i++) {
+        build->hashes[i] = trashmap_hash(build->pairs[i].key);
+    }
+}
+
+// fills slots [p * chunk, (p + 1) * chunk) using only pairs whose home slot is in that range,
+// so no two tasks touch the same slot or item. items are written to the partition's own region of the arena.
+static void trashmap_build_fill_task(void * ctx, size_t task) {
+    trashmap_build_ctx_t* build = (trashmap_build_ctx_t*)ctx;
+    trashmap_t* map = build->map;
+    size_t lo = task * build->chunk;
+    size_t hi = lo + build->chunk < map->slot_count ? lo + build->chunk : map->slot_count;
+    size_t base = build->offsets[task];
+    size_t placed = 0, overflowed = 0;
+    for (size_t i = base; i < build->offsets[task + 1]; i++) {
+        trashmap_index_t pair = build->order[i];
+        trashmap_hash_t hash = build->hashes[pair];
+        const trashmap_item_t* item = &build->pairs[pair];
+        uint64_t tag = UINT64_MAX;
+        size_t idx = hash % map->slot_count;
+        for (; idx < hi; idx++) {
+            trashmap_index_t bidx = map->slots[idx].index;
+            if (bidx == 0) {
+                map->items[base + placed] = *item;
+                placed += 1;
+                map->slots[idx] = trashmap_make_slot(hash, (trashmap_index_t)(base + placed), trashmap_key_tag(item->key));
+                break;
+            }
+            if (trashmap_slot_may_hold(&map->slots[idx], hash, item->key, &tag)
+                && (trashmap_tag_is_key(tag) || trashmap_tag_key_eq(tag, item->key, map->items[bidx - 1].key))) {
+                map->items[bidx - 1].value = item->value;
+                break;
+            }
+        }
+        if (idx == hi) {
+            // every slot up to the next partition is full, probing on would race with that partition.
+            // later duplicates of this key will also reach here, so applying overflow in order keeps the last value.
+            build->overflow[base + overflowed++] = pair;
+        }
+    }
+    build->placed_counts[task] = placed;
+    build->overflow_counts[task] = overflowed;
+}
+
+// points a partition's slots at the compacted positions of its items
+static void trashmap_build_fixup_task(void * ctx, size_t task) {
+    trashmap_build_ctx_t* build = (trashmap_build_ctx_t*)ctx;
+    trashmap_t* map = build->map;
+    size_t lo = task * build->chunk;
+    size_t hi = lo + build->chunk < map->slot_count ? lo + build->chunk : map->slot_count;
+    size_t shift = build->offsets[task] - build->dest[task];
+    if (shift == 0) return;
+    for (size_t idx = lo; idx < hi; idx++) {
+        if (map->slots[idx].index != 0) {
+            map->slots[idx].index -= (trashmap_index_t)shift;
+        }
+    }
+}
+
+bool trashmap_build(trashmap_t* map, const trashmap_item_t * pairs, size_t count, size_t threads) {
+    if (count > TRASHMAP_MAX_ITEMS) {
+        return false;
+    }
+    trashmap_clear(map);
+    if (count == 0) return true;
+
+    // presize exactly, enough items for every pair and enough slots to stay under 75% load
+    if (map->capacity < count) {
+        map->capacity = count;
+        map->items = (trashmap_item_t*)TRASHMAP_REALLOC(map->items, map->capacity * sizeof(*map->items));
+        TRASHMAP_ASSERT(map->items && "out of memory");
+    }
+    size_t slot_count = count + count / 3 + 1;
+    if (map->slot_count < slot_count) {
         TRASHMAP_FREE(map->slots);
+        map->slots = trashmap_alloc_slots(slot_count);
+        map->slot_count = slot_count;
+#ifdef TRASHMAP_FILTER
+        trashmap_filter_alloc(map, slot_count);
+#endif // TRASHMAP_FILTER
+    }
+
+    trashmap_build_ctx_t build;
+    build.map = map;
+    build.pairs = pairs;
+    build.count = count;
+    build.partitions = threads ? threads : 1;
+    if (build.partitions > count) build.partitions = count;
+    build.chunk = (map->slot_count + build.partitions - 1) / build.partitions;
+    // rounding up the chunk can leave fewer non-empty slot ranges than requested
+    build.partitions = (map->slot_count + build.chunk - 1) / build.chunk;
+
+    build.hashes = (trashmap_hash_t*)TRASHMAP_ALLOC(count * sizeof(*build.hashes));
+    build.order = (trashmap_index_t*)TRASHMAP_ALLOC(count * sizeof(*build.order));
+    build.overflow = (trashmap_index_t*)TRASHMAP_ALLOC(count * sizeof(*build.overflow));
+    build.offsets = (size_t*)TRASHMAP_ALLOC((build.partitions + 1) * sizeof(*build.offsets));
+    build.overflow_counts = (size_t*)TRASHMAP_ALLOC(build.partitions * sizeof(*build.overflow_counts));
+    build.placed_counts = (size_t*)TRASHMAP_ALLOC(build.partitions * sizeof(*build.placed_counts));
+    build.dest = (size_t*)TRASHMAP_ALLOC(build.partitions * sizeof(*build.dest));
+    TRASHMAP_ASSERT(build.hashes && build.order && build.overflow && build.offsets
+        && build.overflow_counts && build.placed_counts && build.dest && "out of memory");
+
+    TRASHMAP_PARALLEL_FOR(trashmap_build_hash_task, &build, build.partitions);
+
+    // stable counting sort of pairs by the partition owning their home slot, keeps duplicates in input order
+    trashmap_memset(build.offsets, 0, (build.partitions + 1) * sizeof(*build.offsets));
+    for (size_t i = 0; i < count; i++) {
+        build.offsets[(build.hashes[i] % map->slot_count) / build.chunk + 1] += 1;
+    }
+    for (size_t p = 0; p < build.partitions; p++) {
+        build.offsets[p + 1] += build.offsets[p];
+        build.dest[p] = build.offsets[p];
+    }
+    for (size_t i = 0; i < count; i++) {
+        build.order[build.dest[(build.hashes[i] % map->slot_count) / build.chunk]++] = (trashmap_index_t)i;
+    }
+
+    TRASHMAP_PARALLEL_FOR(trashmap_build_fill_task, &build, build.partitions);
 
-        map->slots = new_slots;
-        map->slot_count = new_slot_count;
+    // close the gaps left by duplicates and overflow, each partition only moves down
+    size_t placed = 0;
+    for (size_t p = 0; p < build.partitions; p++) {
+        build.dest[p] = placed;
+        for (size_t i = 0; i < build.placed_counts[p]; i++) {
+            map->items[placed + i] = map->items[build.offsets[p] + i];
+        }
+        placed += build.placed_counts[p];
+    }
+    TRASHMAP_PARALLEL_FOR(trashmap_build_fixup_task, &build, build.partitions);
+    map->count = placed;
+#ifdef TRASHMAP_FILTER
+    // blocks are shared between partitions, so the filter is filled serially
+    for (size_t i = 0; i < count; i++) {
+        trashmap_filter_add(map, build.hashes[i]);
     }
+#endif // TRASHMAP_FILTER
+
+    for (size_t p = 0; p < build.partitions; p++) {
+        for (size_t i = 0; i < build.overflow_counts[p]; i++) {
+            trashmap_index_t pair = build.overflow[build.offsets[p] + i];
+            trashmap_insert_hashed(map, pairs[pair].key, pairs[pair].value, build.hashes[pair]);
+        }
+    }
+
+    TRASHMAP_FREE(build.hashes);
+    TRASHMAP_FREE(build.order);
+    TRASHMAP_FREE(build.overflow);
+    TRASHMAP_FREE(build.offsets);
+    TRASHMAP_FREE(build.overflow_counts);
+    TRASHMAP_FREE(build.placed_counts);
+    TRASHMAP_FREE(build.dest);
+    return true;
 }
 
-void trashmap_set(trashmap_t* map, const char * key, const char * value) {    
+bool trashmap_merge(trashmap_t* dst, const trashmap_t* src, trashmap_merge_policy_t policy) {
+    if (dst == src || src->count == 0) return true;
+    // enough for no overlap at all, so the loop below never grows the map.
+    // near TRASHMAP_MAX_ITEMS that may not fit, then each new key is reserved on its own
+    bool reserved = trashmap_reserve(dst, src->count);
+#ifndef TRASHMAP_COMPACT_SLOTS
+    // the stored hashes are only reachable through the slots, gather them by item so the items can be
+    // merged in insertion order, which is the order a caller iterating `items` expects
+    trashmap_hash_t* hashes = (trashmap_hash_t*)TRASHMAP_ALLOC(src->count * sizeof(*hashes));
+    TRASHMAP_ASSERT(hashes && "out of memory");
+    for (size_t src_idx = 0; src_idx < src->slot_count; src_idx++) {
+        trashmap_slot_t slot = src->slots[src_idx];
+        if (slot.index != 0) hashes[slot.index - 1] = slot.hash;
+    }
+#endif // TRASHMAP_COMPACT_SLOTS
+    bool merged = true;
+    for (size_t i = 0; i < src->count; i++) {
+        const trashmap_item_t* item = &src->items[i];
+#ifdef TRASHMAP_COMPACT_SLOTS
+        // slots only keep a hash fragment
+        trashmap_hash_t hash = trashmap_hash(item->key);
+#else
+        trashmap_hash_t hash = hashes[i];
+#endif // TRASHMAP_COMPACT_SLOTS
+        size_t idx = trashmap_probe(dst, item->key, hash);
+        bool present = idx != dst->slot_count && dst->slots[idx].index != 0;
+        if (policy == TRASHMAP_MERGE_KEEP && present) continue;
+        if (!reserved && !present) {
+            if (!trashmap_reserve(dst, 1)) {
+                merged = false;
+                break;
+            }
+            idx = trashmap_probe(dst, item->key, hash);
+        }
+        trashmap_insert_at(dst, idx, item->key, item->value, hash);
+    }
+#ifndef TRASHMAP_COMPACT_SLOTS
+    TRASHMAP_FREE(hashes);
+#endif // TRASHMAP_COMPACT_SLOTS
+    return merged;
+}
 
-    trashmap_reserve(map, 1);
+void trashmap_overlay_init(trashmap_overlay_t* overlay, const trashmap_t* const * layers, size_t count) {
+    overlay->layers = layers;
+    overlay->count = count;
+}
 
-    uint32_t hash = trashmap_hash(key);
+bool trashmap_overlay_has(const trashmap_overlay_t* overlay, const char * key) {
+    trashmap_hash_t hash = trashmap_hash(key);
+    for (size_t i = 0; i < overlay->count; i++) {
+        if (trashmap_has_hashed(overlay->layers[i], key, hash)) return true;
+    }
+    return false;
+}
 
-    uint32_t start = hash % map->slot_count;
-    uint32_t idx = start;
+const char* trashmap_overlay_get(const trashmap_overlay_t* overlay, const char * key) {
+    trashmap_hash_t hash = trashmap_hash(key);
+    for (size_t i = 0; i < overlay->count; i++) {
+        const char* value = trashmap_get_hashed(overlay->layers[i], key, hash);
+        if (value) return value;
+    }
+    return NULL;
+}
+
+static inline const trashmap_slot_t* trashmap_image_slots(const trashmap_image_t* image) {
+    return (const trashmap_slot_t*)(image + 1);
+}
+
+static inline const trashmap_image_item_t* trashmap_image_items(const trashmap_image_t* image) {
+    return (const trashmap_image_item_t*)(trashmap_image_slots(image) + image->slot_count);
+}
 
+static inline const char* trashmap_image_strings(const trashmap_image_t* image) {
+    return (const char*)(trashmap_image_items(image) + image->capacity);
+}
+
+static inline size_t trashmap_image_bytes(size_t slot_count, size_t capacity, size_t strings_capacity) {
+    return sizeof(trashmap_image_t) + slot_count * sizeof(trashmap_slot_t)
+        + capacity * sizeof(trashmap_image_item_t) + strings_capacity;
+}
+
+// same as trashmap_probe but over an image, returns the item index or SIZE_MAX if the key is missing.
+static inline size_t trashmap_image_find(const trashmap_image_t* image, const char * key) {
+    const trashmap_slot_t* slots = trashmap_image_slots(image);
+    const trashmap_image_item_t* items = trashmap_image_items(image);
+    const char* strings = trashmap_image_strings(image);
+    trashmap_hash_t hash = trashmap_hash(key);
+    uint64_t tag = UINT64_MAX;
+    size_t slot_count = (size_t)image->slot_count;
+    size_t start = hash % slot_count;
+    size_t idx = start;
     do {
-        uint32_t item_idx = map->slots[idx].index;
-        uint32_t item_hash = map->slots[idx].hash;
-        if (item_idx == UINT32_MAX) {
-            map->items[map->count] = TRASHMAP_LITERAL(trashmap_item_t){.key = key, .value = value};
-            map->slots[idx] = TRASHMAP_LITERAL(trashmap_slot_t){.hash = hash, .index = (uint32_t)map->count};
-            map->count += 1;
-            return;
-        } else if (item_hash == hash && trashmap_strcmp(key, map->items[item_idx].key) == 0) {
-            map->items[item_idx].value = value;
-            return;
+        trashmap_index_t bidx = slots[idx].index;
+        if (bidx == 0) {
+            return SIZE_MAX;
         }
-        idx = (idx + 1) % map->slot_count;
+        if (trashmap_slot_may_hold(&slots[idx], hash, key, &tag)
+            && (trashmap_tag_is_key(tag) || trashmap_tag_key_eq(tag, key, strings + items[bidx - 1].key))) {
+            return bidx - 1;
+        }
+        idx = (idx + 1) % slot_count;
+    } while (idx != start);
+    return SIZE_MAX;
+}
+
+bool trashmap_image_has(const trashmap_image_t* image, const char * key) {
+    return trashmap_image_find(image, key) != SIZE_MAX;
+}
+
+const char* trashmap_image_get(const trashmap_image_t* image, const char * key) {
+    size_t idx = trashmap_image_find(image, key);
+    if (idx == SIZE_MAX) {
+        return NULL;
+    }
+    return trashmap_image_strings(image) + trashmap_image_items(image)[idx].value;
+}
+
+static inline size_t trashmap_strlen(const char * str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    return len;
+}
+
+static inline void trashmap_memcpy(void * dest, const void * src, size_t count) {
+    unsigned char * d = (unsigned char *)dest;
+    const unsigned char * s = (const unsigned char *)src;
+    for (size_t i = 0; i < count; i++) {
+        d[i] = s[i];
+    }
+}
+
+// moves a relocatable map into a new image with the given sizes, rehashing if the slot count changes.
+static void trashmap_reloc_resize(trashmap_reloc_t* map, size_t slot_count, size_t capacity, size_t strings_capacity) {
+    TRASHMAP_ASSERT(strings_capacity <= UINT32_MAX && "relocatable map strings are limited to 4GiB");
+    const trashmap_image_t* old = map->image;
+    size_t size = trashmap_image_bytes(slot_count, capacity, strings_capacity);
+    trashmap_image_t* image = (trashmap_image_t*)TRASHMAP_ALLOC(size);
+    TRASHMAP_ASSERT(image && "out of memory");
+    *image = *old;
+    image->slot_count = slot_count;
+    image->capacity = capacity;
+    image->strings_capacity = strings_capacity;
+
+    trashmap_slot_t* slots = (trashmap_slot_t*)trashmap_image_slots(image);
+    if (slot_count == old->slot_count) {
+        trashmap_memcpy(slots, trashmap_image_slots(old), slot_count * sizeof(*slots));
+    } else {
+        trashmap_memset(slots, 0, slot_count * sizeof(*slots));
+        const trashmap_slot_t* old_slots = trashmap_image_slots(old);
+        for (size_t i = 0; i < old->slot_count; i++) {
+            if (old_slots[i].index == 0) continue;
+#ifdef TRASHMAP_COMPACT_SLOTS
+            trashmap_hash_t hash = trashmap_hash(trashmap_image_strings(old) + trashmap_image_items(old)[old_slots[i].index - 1].key);
+#else
+            trashmap_hash_t hash = old_slots[i].hash;
+#endif // TRASHMAP_COMPACT_SLOTS
+            trashmap_place_slot(slots, slot_count, old_slots[i], hash);
+        }
+    }
+    trashmap_memcpy((void*)trashmap_image_items(image), trashmap_image_items(old), old->count * sizeof(trashmap_image_item_t));
+    trashmap_memcpy((void*)trashmap_image_strings(image), trashmap_image_strings(old), old->strings_size);
+
+    TRASHMAP_FREE(map->image);
+    map->image = image;
+    map->size = size;
+}
+
+void trashmap_reloc_init(trashmap_reloc_t* map, size_t count) {
+    TRASHMAP_ASSERT(count && "hash map must have at least 1 slot to start");
+    size_t size = trashmap_image_bytes(count, 0, 0);
+    map->image = (trashmap_image_t*)TRASHMAP_ALLOC(size);
+    TRASHMAP_ASSERT(map->image && "out of memory");
+    trashmap_memset(map->image, 0, sizeof(trashmap_image_t));
+    map->image->magic = TRASHMAP_IMAGE_MAGIC;
+    map->image->version = TRASHMAP_IMAGE_VERSION;
+    map->image->slot_size = sizeof(trashmap_slot_t);
+    map->image->format = TRASHMAP_IMAGE_FORMAT;
+    map->image->slot_count = count;
+    trashmap_memset((void*)trashmap_image_slots(map->image), 0, count * sizeof(trashmap_slot_t));
+    map->size = size;
+}
+
+void trashmap_reloc_deinit(trashmap_reloc_t* map) {
+    if (map->image) TRASHMAP_FREE(map->image);
+}
+
+bool trashmap_reloc_set(trashmap_reloc_t* map, const char * key, const char * value) {
+    size_t key_size = trashmap_strlen(key) + 1;
+    size_t value_size = trashmap_strlen(value) + 1;
+    trashmap_image_t* image = map->image;
+    if (image->count >= TRASHMAP_MAX_ITEMS && !trashmap_image_has(image, key)) {
+        return false;
+    }
+
+    // same growth policy as trashmap_reserve, applied to each region of the image
+    size_t slot_count = (size_t)image->slot_count;
+    size_t capacity = (size_t)image->capacity;
+    size_t strings_capacity = (size_t)image->strings_capacity;
+    if (image->count + 1 > capacity) {
+        capacity = capacity ? capacity * 2 : 16;
+    }
+    if (image->count + 1 > slot_count * 3 / 4) {
+        slot_count *= 2;
+    }
+    while (image->strings_size + key_size + value_size > strings_capacity) {
+        strings_capacity = strings_capacity ? strings_capacity * 2 : 256;
+    }
+    if (slot_count != image->slot_count || capacity != image->capacity || strings_capacity != image->strings_capacity) {
+        trashmap_reloc_resize(map, slot_count, capacity, strings_capacity);
+        image = map->image;
+    }
+
+    trashmap_slot_t* slots = (trashmap_slot_t*)trashmap_image_slots(image);
+    trashmap_image_item_t* items = (trashmap_image_item_t*)trashmap_image_items(image);
+    char* strings = (char*)trashmap_image_strings(image);
+    trashmap_hash_t hash = trashmap_hash(key);
+    uint64_t tag = UINT64_MAX;
+    size_t start = hash % slot_count;
+    size_t idx = start;
+    do {
+        trashmap_index_t bidx = slots[idx].index;
+        if (bidx == 0) {
+            items[image->count].key = (uint32_t)image->strings_size;
+            trashmap_memcpy(strings + image->strings_size, key, key_size);
+            image->strings_size += key_size;
+            items[image->count].value = (uint32_t)image->strings_size;
+            trashmap_memcpy(strings + image->strings_size, value, value_size);
+            image->strings_size += value_size;
+            image->count += 1;
+            slots[idx] = trashmap_make_slot(hash, (trashmap_index_t)image->count, trashmap_key_tag(key));
+            return true;
+        }
+        if (trashmap_slot_may_hold(&slots[idx], hash, key, &tag)
+            && (trashmap_tag_is_key(tag) || trashmap_tag_key_eq(tag, key, strings + items[bidx - 1].key))) {
+            items[bidx - 1].value = (uint32_t)image->strings_size;
+            trashmap_memcpy(strings + image->strings_size, value, value_size);
+            image->strings_size += value_size;
+            return true;
+        }
+        idx = (idx + 1) % slot_count;
     } while (idx != start);
     TRASHMAP_ASSERT(0 && "corrupted hash map");
+    return false;
+}
+
+void trashmap_reloc_clone(trashmap_reloc_t* dst, const trashmap_reloc_t* src) {
+    dst->image = (trashmap_image_t*)TRASHMAP_ALLOC(src->size);
+    TRASHMAP_ASSERT(dst->image && "out of memory");
+    trashmap_memcpy(dst->image, src->image, src->size);
+    dst->size = src->size;
+}
+
+#ifdef TRASHMAP_MMAP
+
+bool trashmap_save(const trashmap_t* map, const char * path) {
+    trashmap_image_t header;
+    trashmap_memset(&header, 0, sizeof(header));
+    header.magic = TRASHMAP_IMAGE_MAGIC;
+    header.version = TRASHMAP_IMAGE_VERSION;
+    header.slot_size = sizeof(trashmap_slot_t);
+    header.format = TRASHMAP_IMAGE_FORMAT;
+    header.slot_count = map->slot_count;
+    header.count = map->count;
+
+    // items keep their indices so the slots can be written unchanged
+    trashmap_image_item_t* items = (trashmap_image_item_t*)TRASHMAP_ALLOC((map->count + 1) * sizeof(*items));
+    TRASHMAP_ASSERT(items && "out of memory");
+    uint64_t offset = 0;
+    for (size_t i = 0; i < map->count; i++) {
+        items[i].key = (uint32_t)offset;
+        offset += trashmap_strlen(map->items[i].key) + 1;
+        items[i].value = (uint32_t)offset;
+        offset += trashmap_strlen(map->items[i].value) + 1;
+        if (offset > UINT32_MAX) {
+            TRASHMAP_FREE(items);
+            return false;
+        }
+    }
+    header.capacity = map->count;
+    header.strings_size = offset;
+    header.strings_capacity = offset;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        TRASHMAP_FREE(items);
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(map->slots, sizeof(*map->slots), map->slot_count, file) == map->slot_count
+        && fwrite(items, sizeof(*items), map->count, file) == map->count;
+    for (size_t i = 0; ok && i < map->count; i++) {
+        ok = fwrite(map->items[i].key, items[i].value - items[i].key, 1, file) == 1
+            && fwrite(map->items[i].value, trashmap_strlen(map->items[i].value) + 1, 1, file) == 1;
+    }
+    TRASHMAP_FREE(items);
+    ok = fclose(file) == 0 && ok;
+    return ok;
+}
+
+bool trashmap_open_mapped(trashmap_mapped_t* mapped, const char * path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(trashmap_image_t)) {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+    // only the header is validated so opening stays O(1), the body is trusted to come from trashmap_save
+    const trashmap_image_t* image = (const trashmap_image_t*)base;
+    bool ok = image->magic == TRASHMAP_IMAGE_MAGIC
+        && image->version == TRASHMAP_IMAGE_VERSION
+        && image->slot_size == sizeof(trashmap_slot_t)
+        && image->format == TRASHMAP_IMAGE_FORMAT
+        && image->slot_count != 0
+        && image->count <= image->capacity
+        && image->strings_size <= image->strings_capacity
+        && trashmap_image_bytes((size_t)image->slot_count, (size_t)image->capacity, (size_t)image->strings_capacity) == size;
+    if (!ok) {
+        munmap(base, size);
+        return false;
+    }
+    mapped->image = image;
+    mapped->size = size;
+    return true;
+}
+
+void trashmap_close_mapped(trashmap_mapped_t* mapped) {
+    if (mapped->image) munmap((void*)mapped->image, mapped->size);
+    mapped->image = NULL;
+    mapped->size = 0;
+}
+
+#endif // TRASHMAP_MMAP
+
+// returns the index of the first byte in buf[0, len) equal to `a` or `b`, or `len` if there is none.
+static inline size_t trashmap_find_either(const char * buf, size_t len, char a, char b) {
+    size_t i = 0;
+#if defined(__AVX2__)
+    __m256i wide_a = _mm256_set1_epi8(a), wide_b = _mm256_set1_epi8(b);
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(buf + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, wide_a), _mm256_cmpeq_epi8(chunk, wide_b)));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i vec_a = _mm_set1_epi8(a), vec_b = _mm_set1_epi8(b);
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(buf + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, vec_a), _mm_cmpeq_epi8(chunk, vec_b)));
+        if (mask) return i + (size_t)__builtin_ctz(mask);
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    uint8x16_t vec_a = vdupq_n_u8((uint8_t)a), vec_b = vdupq_n_u8((uint8_t)b);
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t*)(buf + i));
+        // neon has no movemask, find the chunk then let the scalar loop find the byte
+        if (vmaxvq_u8(vorrq_u8(vceqq_u8(chunk, vec_a), vceqq_u8(chunk, vec_b)))) break;
+    }
+#endif
+    for (; i < len; i++) {
+        if (buf[i] == a || buf[i] == b) return i;
+    }
+    return len;
+}
+
+// one bit per byte value, set for the RFC 9110 token characters allowed in a header name
+static const uint64_t trashmap_token_bits[4] = {0x03ff6cfa00000000ull, 0x57ffffffc7fffffeull, 0, 0};
+
+// lowercases header name bytes in place and continues the FNV-1a hash in `hash` over the lowered bytes in the
+// same loop, so a name split across reads can be hashed a piece at a time. returns false if any byte is not
+// a token character, anything else (a nul in particular) would make the stored key differ from the hashed name.
+static inline bool trashmap_lower_hash(trashmap_hash_t* hash, char * name, size_t len) {
+    trashmap_hash_t h = *hash;
+    uint64_t token = 1;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)name[i];
+        token &= trashmap_token_bits[c >> 6] >> (c & 63);
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        name[i] = (char)c;
+        h = trashmap_fnv_1a_step(h, c);
+    }
+    *hash = h;
+    return token & 1;
+}
+
+// the hash of a lowercased, nul terminated name given the hash built up by trashmap_lower_hash
+static inline trashmap_hash_t trashmap_header_hash(trashmap_hash_t scanned, const char * name) {
+#ifndef TRASHMAP_CUSTOM_HASH_FUNCTION
+    (void)name;
+    return scanned;
+#else
+    (void)scanned;
+    return trashmap_hash(name);
+#endif // TRASHMAP_CUSTOM_HASH_FUNCTION
+}
+
+size_t trashmap_parse_headers(trashmap_t* map, char * buf, size_t len) {
+    // find the empty line before touching anything, so an incomplete block can be retried once more is read
+    size_t end = 0;
+    for (;;) {
+        size_t nl = end + trashmap_find_either(buf + end, len - end, '\n', '\n');
+        if (nl == len) {
+            return 0;
+        }
+        bool empty = nl == end || (nl == end + 1 && buf[end] == '\r');
+        end = nl + 1;
+        if (empty) break;
+    }
+    len = end;
+
+    size_t pos = 0;
+    while (pos < len) {
+        char * line = buf + pos;
+        size_t remaining = len - pos;
+        if (line[0] == '\n') {
+            return pos + 1;
+        }
+        if (line[0] == '\r') {
+            return remaining >= 2 && line[1] == '\n' ? pos + 2 : 0;
+        }
+        // obsolete line folding is not supported
+        if (line[0] == ' ' || line[0] == '\t') {
+            return 0;
+        }
+        size_t colon = trashmap_find_either(line, remaining, ':', '\n');
+        if (colon == 0 || colon == remaining || line[colon] != ':') {
+            return 0;
+        }
+        size_t eol = colon + 1 + trashmap_find_either(line + colon + 1, remaining - colon - 1, '\n', '\n');
+        if (eol == remaining) {
+            return 0;
+        }
+
+        trashmap_hash_t hash = FNV_1A_OFFSET_BASIS;
+        if (!trashmap_lower_hash(&hash, line, colon)) {
+            return 0;
+        }
+        line[colon] = '\0';
+        hash = trashmap_header_hash(hash, line);
+
+        size_t value = colon + 1;
+        while (value < eol && (line[value] == ' ' || line[value] == '\t')) value++;
+        size_t value_end = eol;
+        while (value_end > value && (line[value_end - 1] == '\r' || line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) value_end--;
+        line[value_end] = '\0';
+
+        if (!trashmap_set_hashed(map, line, line + value, hash)) {
+            return 0;
+        }
+        pos += eol + 1;
+    }
+    return 0;
+}
+
+static inline char* trashmap_header_spill_data(trashmap_header_spill_t* spill) {
+    return (char*)(spill + 1);
+}
+
+// appends bytes to the current line, which always sits at the end of the newest spill block.
+// if it no longer fits the line moves to a new block, earlier lines stay where they are.
+static void trashmap_header_spill_append(trashmap_header_parser_t* parser, const char * bytes, size_t count) {
+    trashmap_header_spill_t* spill = parser->spill;
+    if (!spill || spill->used + parser->line_len + count > spill->capacity) {
+        size_t capacity = 2 * (parser->line_len + count);
+        if (capacity < 4096) capacity = 4096;
+        trashmap_header_spill_t* block = (trashmap_header_spill_t*)TRASHMAP_ALLOC(sizeof(*block) + capacity);
+        TRASHMAP_ASSERT(block && "out of memory");
+        block->next = spill;
+        block->capacity = capacity;
+        block->used = 0;
+        if (spill) {
+            trashmap_memcpy(trashmap_header_spill_data(block), trashmap_header_spill_data(spill) + spill->used, parser->line_len);
+        }
+        parser->spill = spill = block;
+    }
+    trashmap_memcpy(trashmap_header_spill_data(spill) + spill->used + parser->line_len, bytes, count);
+    parser->line_len += count;
+}
+
+void trashmap_header_parser_init(trashmap_header_parser_t* parser, trashmap_t* map) {
+    parser->map = map;
+    parser->spill = NULL;
+    parser->state = TRASHMAP_HEADER_LINE_START;
+    parser->spilled = false;
+    parser->line_len = 0;
+    parser->name_len = 0;
+    parser->hash = FNV_1A_OFFSET_BASIS;
+}
+
+void trashmap_header_parser_deinit(trashmap_header_parser_t* parser) {
+    while (parser->spill) {
+        trashmap_header_spill_t* next = parser->spill->next;
+        TRASHMAP_FREE(parser->spill);
+        parser->spill = next;
+    }
+}
+
+// terminates and inserts a complete line, `line_len` includes the trailing '\n'
+static bool trashmap_header_parser_finish(trashmap_header_parser_t* parser, char * line, size_t line_len) {
+    size_t colon = parser->name_len;
+    if (colon == 0) {
+        return false;
+    }
+    line[colon] = '\0';
+    size_t value = colon + 1;
+    size_t value_end = line_len - 1;
+    while (value < value_end && (line[value] == ' ' || line[value] == '\t')) value++;
+    while (value_end > value && (line[value_end - 1] == '\r' || line[value_end - 1] == ' ' || line[value_end - 1] == '\t')) value_end--;
+    line[value_end] = '\0';
+    return trashmap_set_hashed(parser->map, line, line + value, trashmap_header_hash(parser->hash, line));
+}
+
+trashmap_parse_result_t trashmap_header_parser_feed(trashmap_header_parser_t* parser, char * chunk, size_t len, size_t * consumed) {
+    if (parser->state == TRASHMAP_HEADER_DONE) {
+        *consumed = 0;
+        return TRASHMAP_PARSE_DONE;
+    }
+    size_t pos = 0;
+    // start of the current line in this chunk, a line continued from an earlier chunk starts at 0
+    size_t line_start = 0;
+    while (pos < len && parser->state != TRASHMAP_HEADER_ERROR) {
+        switch (parser->state) {
+        case TRASHMAP_HEADER_LINE_START:
+            if (chunk[pos] == '\n') {
+                parser->state = TRASHMAP_HEADER_DONE;
+                *consumed = pos + 1;
+                return TRASHMAP_PARSE_DONE;
+            }
+            if (chunk[pos] == '\r') {
+                parser->state = TRASHMAP_HEADER_BLANK_CR;
+                pos += 1;
+            } else if (chunk[pos] == ' ' || chunk[pos] == '\t') {
+                // obsolete line folding is not supported
+                parser->state = TRASHMAP_HEADER_ERROR;
+            } else {
+                parser->state = TRASHMAP_HEADER_NAME;
+                parser->spilled = false;
+                parser->name_len = 0;
+                parser->hash = FNV_1A_OFFSET_BASIS;
+                line_start = pos;
+            }
+            break;
+        case TRASHMAP_HEADER_BLANK_CR:
+            if (chunk[pos] != '\n') {
+                parser->state = TRASHMAP_HEADER_ERROR;
+                break;
+            }
+            parser->state = TRASHMAP_HEADER_DONE;
+            *consumed = pos + 1;
+            return TRASHMAP_PARSE_DONE;
+        case TRASHMAP_HEADER_NAME: {
+            size_t end = pos + trashmap_find_either(chunk + pos, len - pos, ':', '\n');
+            bool token = trashmap_lower_hash(&parser->hash, chunk + pos, end - pos);
+            parser->name_len += end - pos;
+            if (!token || (end < len && chunk[end] == '\n')) {
+                parser->state = TRASHMAP_HEADER_ERROR;
+            } else if (end < len) {
+                parser->state = TRASHMAP_HEADER_VALUE;
+                end += 1;
+            }
+            pos = end;
+            break;
+        }
+        case TRASHMAP_HEADER_VALUE: {
+            size_t end = pos + trashmap_find_either(chunk + pos, len - pos, '\n', '\n');
+            if (end == len) {
+                pos = end;
+                break;
+            }
+            pos = end + 1;
+            bool ok;
+            if (parser->spilled) {
+                trashmap_header_spill_append(parser, chunk, pos);
+                ok = trashmap_header_parser_finish(parser, trashmap_header_spill_data(parser->spill) + parser->spill->used, parser->line_len);
+                parser->spill->used += parser->line_len;
+                parser->line_len = 0;
+            } else {
+                ok = trashmap_header_parser_finish(parser, chunk + line_start, pos - line_start);
+            }
+            parser->state = ok ? TRASHMAP_HEADER_LINE_START : TRASHMAP_HEADER_ERROR;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (parser->state == TRASHMAP_HEADER_ERROR) {
+        return TRASHMAP_PARSE_ERROR;
+    }
+    // the chunk ended part way through a line, keep what there is of it
+    if (parser->state == TRASHMAP_HEADER_NAME || parser->state == TRASHMAP_HEADER_VALUE) {
+        trashmap_header_spill_append(parser, chunk + line_start, len - line_start);
+        parser->spilled = true;
+    }
+    return TRASHMAP_PARSE_INCOMPLETE;
+}
+
+#define TRASHMAP_CONCURRENT_EMPTY 0
+
+void trashmap_concurrent_init(trashmap_concurrent_t* map, size_t capacity) {
+    TRASHMAP_ASSERT(capacity && "concurrent hash map must have room for at least 1 item");
+    TRASHMAP_ASSERT(capacity < UINT32_MAX && "concurrent hash map capacity too large");
+    // the concurrent map cannot grow, so size slots up front to keep the load factor under 75%
+    size_t slot_count = capacity + capacity / 3 + 1;
+    map->slots = (uint64_t*)TRASHMAP_CALLOC(slot_count, sizeof(*map->slots));
+    TRASHMAP_ASSERT(map->slots && "out of memory");
+    map->items = (trashmap_item_t*)TRASHMAP_ALLOC(capacity * sizeof(*map->items));
+    TRASHMAP_ASSERT(map->items && "out of memory");
+    map->slot_count = slot_count;
+    map->capacity = capacity;
+    map->count = 0;
+}
+
+void trashmap_concurrent_deinit(trashmap_concurrent_t* map) {
+    if (map->slots) TRASHMAP_FREE(map->slots);
+    if (map->items) TRASHMAP_FREE(map->items);
+}
+
+const char* trashmap_concurrent_get(const trashmap_concurrent_t* map, const char * key) {
+    uint32_t hash = (uint32_t)trashmap_hash(key);
+    size_t start = hash % map->slot_count;
+    size_t idx = start;
+    do {
+        // acquire pairs with the release in trashmap_concurrent_set, so the item is fully written
+        uint64_t slot = __atomic_load_n(&map->slots[idx], __ATOMIC_ACQUIRE);
+        if (slot == TRASHMAP_CONCURRENT_EMPTY) {
+            return NULL;
+        }
+        const trashmap_item_t * item = &map->items[(uint32_t)slot - 1];
+        if ((uint32_t)(slot >> 32) == hash && trashmap_streq(key, item->key)) {
+            return __atomic_load_n(&item->value, __ATOMIC_ACQUIRE);
+        }
+        idx = (idx + 1) % map->slot_count;
+    } while (idx != start);
+    return NULL;
+}
+
+bool trashmap_concurrent_has(const trashmap_concurrent_t* map, const char * key) {
+    uint32_t hash = (uint32_t)trashmap_hash(key);
+    size_t start = hash % map->slot_count;
+    size_t idx = start;
+    do {
+        uint64_t slot = __atomic_load_n(&map->slots[idx], __ATOMIC_ACQUIRE);
+        if (slot == TRASHMAP_CONCURRENT_EMPTY) {
+            return false;
+        }
+        if ((uint32_t)(slot >> 32) == hash && trashmap_streq(key, map->items[(uint32_t)slot - 1].key)) {
+            return true;
+        }
+        idx = (idx + 1) % map->slot_count;
+    } while (idx != start);
+    return false;
+}
+
+bool trashmap_concurrent_set(trashmap_concurrent_t* map, const char * key, const char * value) {
+    uint32_t hash = (uint32_t)trashmap_hash(key);
+    size_t start = hash % map->slot_count;
+    size_t idx = start;
+    // the item is only claimed once an empty slot is found, and is kept across lost races.
+    // if another thread publishes the same key first our claimed item is wasted, the arena is append only.
+    size_t item_idx = SIZE_MAX;
+    do {
+        uint64_t slot = __atomic_load_n(&map->slots[idx], __ATOMIC_ACQUIRE);
+        if (slot == TRASHMAP_CONCURRENT_EMPTY) {
+            if (item_idx == SIZE_MAX) {
+                item_idx = __atomic_fetch_add(&map->count, 1, __ATOMIC_RELAXED);
+                if (item_idx >= map->capacity) {
+                    return false;
+                }
+                map->items[item_idx].key = key;
+                __atomic_store_n(&map->items[item_idx].value, value, __ATOMIC_RELAXED);
+            }
+            uint64_t packed = ((uint64_t)hash << 32) | (uint64_t)(item_idx + 1);
+            if (__atomic_compare_exchange_n(&map->slots[idx], &slot, packed, false, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+                return true;
+            }
+            // lost the race for this slot, `slot` now holds the winner which may be the same key
+        }
+        if ((uint32_t)(slot >> 32) == hash && trashmap_streq(key, map->items[(uint32_t)slot - 1].key)) {
+            __atomic_store_n(&map->items[(uint32_t)slot - 1].value, value, __ATOMIC_RELEASE);
+            return true;
+        }
+        idx = (idx + 1) % map->slot_count;
+    } while (idx != start);
+    return false;
+}
+
+#define TRASHMAP_SHARD_WRITER UINT32_MAX
+
+static inline void trashmap_shard_read_lock(trashmap_shard_t* shard) {
+    for (;;) {
+        uint32_t state = __atomic_load_n(&shard->lock, __ATOMIC_RELAXED);
+        if (state != TRASHMAP_SHARD_WRITER && state + 1 != TRASHMAP_SHARD_WRITER
+            && __atomic_compare_exchange_n(&shard->lock, &state, state + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        TRASHMAP_SPIN_PAUSE();
+    }
+}
+
+static inline void trashmap_shard_read_unlock(trashmap_shard_t* shard) {
+    __atomic_fetch_sub(&shard->lock, 1, __ATOMIC_RELEASE);
+}
+
+static inline void trashmap_shard_write_lock(trashmap_shard_t* shard) {
+    for (;;) {
+        uint32_t state = 0;
+        if (__atomic_load_n(&shard->lock, __ATOMIC_RELAXED) == 0
+            && __atomic_compare_exchange_n(&shard->lock, &state, TRASHMAP_SHARD_WRITER, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+        TRASHMAP_SPIN_PAUSE();
+    }
+}
+
+static inline void trashmap_shard_write_unlock(trashmap_shard_t* shard) {
+    __atomic_store_n(&shard->lock, 0, __ATOMIC_RELEASE);
+}
+
+// uses the high bits of the hash multiplied by an odd constant. the low bits pick the slot within the shard and
+// TRASHMAP_COMPACT_SLOTS keeps the high bits as the slot fingerprint, so the raw high bits would be equal in a shard
+static inline trashmap_shard_t* trashmap_shard_of(const trashmap_sharded_t* map, trashmap_hash_t hash) {
+    if (map->shard_bits == 0) {
+        return map->shards;
+    }
+#ifdef TRASHMAP_64BIT
+    trashmap_hash_t mixed = hash * 0x9e3779b97f4a7c15ull;
+#else
+    trashmap_hash_t mixed = hash * 0x9e3779b1u;
+#endif // TRASHMAP_64BIT
+    return &map->shards[mixed >> (sizeof(trashmap_hash_t) * 8 - map->shard_bits)];
+}
+
+void trashmap_sharded_init(trashmap_sharded_t* map, size_t shard_count, size_t count) {
+    TRASHMAP_ASSERT(shard_count && (shard_count & (shard_count - 1)) == 0 && "shard count must be a power of two");
+    unsigned shard_bits = 0;
+    while (((size_t)1 << shard_bits) < shard_count) {
+        shard_bits++;
+    }
+    TRASHMAP_ASSERT(shard_bits <= 16 && "too many shards");
+    map->shards = (trashmap_shard_t*)TRASHMAP_ALLOC(shard_count * sizeof(*map->shards));
+    TRASHMAP_ASSERT(map->shards && "out of memory");
+    for (size_t i = 0; i < shard_count; i++) {
+        trashmap_init(&map->shards[i].map, count);
+        map->shards[i].lock = 0;
+    }
+    map->shard_count = shard_count;
+    map->shard_bits = shard_bits;
+}
+
+void trashmap_sharded_deinit(trashmap_sharded_t* map) {
+    if (!map->shards) return;
+    for (size_t i = 0; i < map->shard_count; i++) {
+        trashmap_deinit(&map->shards[i].map);
+    }
+    TRASHMAP_FREE(map->shards);
+}
+
+bool trashmap_sharded_has(trashmap_sharded_t* map, const char * key) {
+    trashmap_hash_t hash = trashmap_hash(key);
+    trashmap_shard_t* shard = trashmap_shard_of(map, hash);
+    trashmap_shard_read_lock(shard);
+    bool found = trashmap_has_hashed(&shard->map, key, hash);
+    trashmap_shard_read_unlock(shard);
+    return found;
+}
+
+const char* trashmap_sharded_get(trashmap_sharded_t* map, const char * key) {
+    trashmap_hash_t hash = trashmap_hash(key);
+    trashmap_shard_t* shard = trashmap_shard_of(map, hash);
+    trashmap_shard_read_lock(shard);
+    // values are owned by the caller so the pointer stays valid after unlocking
+    const char* value = trashmap_get_hashed(&shard->map, key, hash);
+    trashmap_shard_read_unlock(shard);
+    return value;
+}
+
+bool trashmap_sharded_set(trashmap_sharded_t* map, const char * key, const char * value) {
+    trashmap_hash_t hash = trashmap_hash(key);
+    trashmap_shard_t* shard = trashmap_shard_of(map, hash);
+    trashmap_shard_write_lock(shard);
+    bool set = trashmap_set_hashed(&shard->map, key, value, hash);
+    trashmap_shard_write_unlock(shard);
+    return set;
+}
+
+void trashmap_cache_init(trashmap_cache_t* cache, size_t capacity, trashmap_evict_fn on_evict, void * ctx) {
+    TRASHMAP_ASSERT(capacity && "cache must have room for at least 1 item");
+    // clamped rather than asserted, a larger cache would truncate slot indices once full
+    if (capacity > TRASHMAP_MAX_ITEMS) capacity = TRASHMAP_MAX_ITEMS;
+    trashmap_init(&cache->map, 2 * capacity);
+    cache->map.items = (trashmap_item_t*)TRASHMAP_ALLOC(capacity * sizeof(*cache->map.items));
+    TRASHMAP_ASSERT(cache->map.items && "out of memory");
+    cache->map.capacity = capacity;
+    cache->referenced = (unsigned char*)TRASHMAP_CALLOC(capacity, 1);
+    cache->hashes = (trashmap_hash_t*)TRASHMAP_ALLOC(capacity * sizeof(*cache->hashes));
+    TRASHMAP_ASSERT(cache->referenced && cache->hashes && "out of memory");
+    cache->hand = 0;
+    cache->on_evict = on_evict;
+    cache->ctx = ctx;
+    cache->evictions = 0;
+    cache->used = 0;
+    cache->expires = NULL;
+    cache->free_items = NULL;
+    cache->free_count = 0;
+    cache->clock = NULL;
+    cache->clock_ctx = NULL;
+    cache->sweep = 0;
+    cache->expirations = 0;
+}
+
+static inline void trashmap_cache_release_all(trashmap_cache_t* cache) {
+    if (!cache->on_evict) return;
+    for (size_t i = 0; i < cache->used; i++) {
+        if (!cache->map.items[i].key) continue;
+        cache->on_evict(cache->ctx, cache->map.items[i].key, cache->map.items[i].value);
+    }
+}
+
+void trashmap_cache_deinit(trashmap_cache_t* cache) {
+    trashmap_cache_release_all(cache);
+    trashmap_deinit(&cache->map);
+    TRASHMAP_FREE(cache->referenced);
+    TRASHMAP_FREE(cache->hashes);
+    if (cache->expires) TRASHMAP_FREE(cache->expires);
+    if (cache->free_items) TRASHMAP_FREE(cache->free_items);
+}
+
+void trashmap_cache_clear(trashmap_cache_t* cache) {
+    trashmap_cache_release_all(cache);
+    trashmap_clear(&cache->map);
+    trashmap_memset(cache->referenced, 0, cache->map.capacity);
+    cache->hand = 0;
+    cache->used = 0;
+    cache->free_count = 0;
+    cache->sweep = 0;
+}
+
+void trashmap_cache_set_clock(trashmap_cache_t* cache, trashmap_clock_fn clock, void * ctx) {
+    TRASHMAP_ASSERT(clock && "cache clock must not be NULL");
+    if (!cache->expires) {
+        size_t capacity = cache->map.capacity;
+        cache->expires = (uint64_t*)TRASHMAP_ALLOC(capacity * sizeof(*cache->expires));
+        cache->free_items = (trashmap_index_t*)TRASHMAP_ALLOC(capacity * sizeof(*cache->free_items));
+        TRASHMAP_ASSERT(cache->expires && cache->free_items && "out of memory");
+        // items set before the clock never expire
+        for (size_t i = 0; i < capacity; i++) cache->expires[i] = UINT64_MAX;
+    }
+    cache->clock = clock;
+    cache->clock_ctx = ctx;
+}
+
+// an item without a deadline never expires, so the clock is only read for items with one
+static inline bool trashmap_cache_expired(const trashmap_cache_t* cache, size_t item) {
+    return cache->expires && cache->expires[item] != UINT64_MAX && cache->expires[item] <= cache->clock(cache->clock_ctx);
+}
+
+// removes the item's slot and hands the pair to the callback, its place in the arena is left to the caller
+static inline void trashmap_cache_drop(trashmap_cache_t* cache, size_t item) {
+    trashmap_t* map = &cache->map;
+    // the slot pointing at the item is the first one from its home with that index, no key comparisons needed
+    size_t idx = cache->hashes[item] % map->slot_count;
+    while (map->slots[idx].index != item + 1) {
+        idx = idx + 1 < map->slot_count ? idx + 1 : 0;
+    }
+    trashmap_remove_slot(map, idx);
+    map->count -= 1;
+    cache->referenced[item] = 0;
+    if (cache->on_evict) {
+        cache->on_evict(cache->ctx, map->items[item].key, map->items[item].value);
+    }
+#ifdef TRASHMAP_FILTER
+    // dropped keys can't be cleared from the filter, rebuilding once per `capacity` drops bounds how many linger
+    if ((cache->evictions + cache->expirations + 1) % map->capacity == 0) {
+        trashmap_memset(map->filter, 0, map->filter_blocks * sizeof(*map->filter));
+        trashmap_filter_rebuild(map);
+    }
+#endif // TRASHMAP_FILTER
+}
+
+static inline void trashmap_cache_expire(trashmap_cache_t* cache, size_t item) {
+    trashmap_cache_drop(cache, item);
+    cache->expirations += 1;
+    cache->map.items[item].key = NULL;
+    cache->free_items[cache->free_count++] = (trashmap_index_t)item;
+}
+
+// the item holding `key` or SIZE_MAX, the caller checks expiry and counts the hit or miss
+static inline size_t trashmap_cache_find(const trashmap_cache_t* cache, const char * key) {
+    const trashmap_t* map = &cache->map;
+    trashmap_hash_t hash = trashmap_hash(key);
+    TRASHMAP_COUNT(map, gets, 1);
+#ifdef TRASHMAP_FILTER
+    if (!trashmap_filter_may_have(map, hash)) {
+        TRASHMAP_COUNT(map, filtered, 1);
+        return SIZE_MAX;
+    }
+#endif // TRASHMAP_FILTER
+    size_t idx = trashmap_probe(map, key, hash);
+    if (idx == map->slot_count || map->slots[idx].index == 0) {
+        return SIZE_MAX;
+    }
+    return map->slots[idx].index - 1;
+}
+
+bool trashmap_cache_has(const trashmap_cache_t* cache, const char * key) {
+    size_t item = trashmap_cache_find(cache, key);
+    bool found = item != SIZE_MAX && !trashmap_cache_expired(cache, item);
+    TRASHMAP_COUNT(&cache->map, hits, found);
+    TRASHMAP_COUNT(&cache->map, misses, !found);
+    return found;
+}
+
+const char* trashmap_cache_get(trashmap_cache_t* cache, const char * key) {
+    size_t item = trashmap_cache_find(cache, key);
+    if (item == SIZE_MAX) {
+        TRASHMAP_COUNT(&cache->map, misses, 1);
+        return NULL;
+    }
+    if (trashmap_cache_expired(cache, item)) {
+        TRASHMAP_COUNT(&cache->map, misses, 1);
+        trashmap_cache_expire(cache, item);
+        return NULL;
+    }
+    TRASHMAP_COUNT(&cache->map, hits, 1);
+    cache->referenced[item] = 1;
+    return cache->map.items[item].value;
+}
+
+// advances the CLOCK hand to the first expired item or item not read since the hand last passed it,
+// and drops it. only called while every item in the arena is live.
+static inline size_t trashmap_cache_evict(trashmap_cache_t* cache) {
+    size_t item = cache->hand;
+    uint64_t now = cache->expires ? cache->clock(cache->clock_ctx) : 0;
+    while (cache->referenced[item] && !(cache->expires && cache->expires[item] <= now)) {
+        cache->referenced[item] = 0;
+        item = item + 1 < cache->used ? item + 1 : 0;
+    }
+    cache->hand = item + 1 < cache->used ? item + 1 : 0;
+    trashmap_cache_drop(cache, item);
+    cache->evictions += 1;
+    return item;
+}
+
+static inline void trashmap_cache_insert(trashmap_cache_t* cache, const char * key, const char * value, uint64_t expires) {
+    trashmap_t* map = &cache->map;
+    trashmap_hash_t hash = trashmap_hash(key);
+    size_t idx = trashmap_probe(map, key, hash);
+    TRASHMAP_ASSERT(idx != map->slot_count && "corrupted hash map");
+    TRASHMAP_COUNT(map, sets, 1);
+
+    size_t item;
+    if (map->slots[idx].index != 0) {
+        TRASHMAP_COUNT(map, overwrites, 1);
+        item = map->slots[idx].index - 1;
+        if (cache->on_evict) {
+            cache->on_evict(cache->ctx, map->items[item].key, map->items[item].value);
+        }
+        cache->referenced[item] = 1;
+    } else {
+        if (cache->free_count) {
+            item = cache->free_items[--cache->free_count];
+        } else if (cache->used < map->capacity) {
+            item = cache->used++;
+        } else {
+            item = trashmap_cache_evict(cache);
+        }
+        cache->referenced[item] = 0;
+        cache->hashes[item] = hash;
+        // eviction may have shifted slots, so the empty slot found above can't be reused
+        trashmap_place_slot(map->slots, map->slot_count, trashmap_make_slot(hash, (trashmap_index_t)(item + 1), trashmap_key_tag(key)), hash);
+        map->count += 1;
+#ifdef TRASHMAP_FILTER
+        trashmap_filter_add(map, hash);
+#endif // TRASHMAP_FILTER
+    }
+    map->items[item] = TRASHMAP_LITERAL(trashmap_item_t){.key = key, .value = value};
+    if (cache->expires) {
+        cache->expires[item] = expires;
+    }
+}
+
+void trashmap_cache_set(trashmap_cache_t* cache, const char * key, const char * value) {
+    trashmap_cache_insert(cache, key, value, UINT64_MAX);
+}
+
+void trashmap_cache_set_ttl(trashmap_cache_t* cache, const char * key, const char * value, uint64_t ttl) {
+    TRASHMAP_ASSERT(cache->clock && "trashmap_cache_set_ttl requires trashmap_cache_set_clock");
+    uint64_t now = cache->clock(cache->clock_ctx);
+    trashmap_cache_insert(cache, key, value, ttl < UINT64_MAX - now ? now + ttl : UINT64_MAX);
+}
+
+size_t trashmap_cache_sweep(trashmap_cache_t* cache, size_t budget) {
+    if (!cache->expires || cache->used == 0) return 0;
+    uint64_t now = cache->clock(cache->clock_ctx);
+    size_t removed = 0;
+    for (size_t n = 0; n < budget && n < cache->used; n++) {
+        size_t item = cache->sweep;
+        cache->sweep = item + 1 < cache->used ? item + 1 : 0;
+        if (cache->map.items[item].key && cache->expires[item] <= now) {
+            trashmap_cache_expire(cache, item);
+            removed += 1;
+        }
+    }
+    return removed;
+}
+
+void trashmap_pool_init(trashmap_pool_t* pool, size_t slot_count, size_t slot_watermark, size_t max_idle) {
+    TRASHMAP_ASSERT(slot_count && "hash map must have at least 1 slot to start");
+    TRASHMAP_ASSERT(slot_count <= slot_watermark && "pool watermark must not be below the initial slot count");
+    pool->idle = NULL;
+    pool->idle_count = 0;
+    pool->idle_capacity = 0;
+    pool->slot_count = slot_count;
+    pool->slot_watermark = slot_watermark;
+    pool->max_idle = max_idle;
+}
+
+void trashmap_pool_deinit(trashmap_pool_t* pool) {
+    trashmap_pool_trim(pool, 0);
+}
+
+void trashmap_pool_acquire(trashmap_pool_t* pool, trashmap_t* map) {
+    if (pool->idle_count == 0) {
+        trashmap_init(map, pool->slot_count);
+        return;
+    }
+    // the most recently released map is the most likely to still be in cache
+    *map = pool->idle[--pool->idle_count];
+#ifdef TRASHMAP_STATS
+    map->rehash_count = 0;
+#endif // TRASHMAP_STATS
+#ifdef TRASHMAP_COUNTERS
+    trashmap_memset(&map->counters, 0, sizeof(map->counters));
+#endif // TRASHMAP_COUNTERS
+}
+
+void trashmap_pool_release(trashmap_pool_t* pool, trashmap_t* map) {
+    if (pool->idle_count == pool->max_idle) {
+        trashmap_deinit(map);
+        return;
+    }
+    if (pool->idle_count == pool->idle_capacity) {
+        size_t capacity = pool->idle_capacity ? pool->idle_capacity * 2 : 16;
+        if (capacity > pool->max_idle) capacity = pool->max_idle;
+        pool->idle = (trashmap_t*)TRASHMAP_REALLOC(pool->idle, capacity * sizeof(*pool->idle));
+        TRASHMAP_ASSERT(pool->idle && "out of memory");
+        pool->idle_capacity = capacity;
+    }
+    trashmap_clear_shrink(map, pool->slot_watermark);
+    pool->idle[pool->idle_count++] = *map;
+}
+
+void trashmap_pool_trim(trashmap_pool_t* pool, size_t keep) {
+    while (pool->idle_count > keep) {
+        trashmap_deinit(&pool->idle[--pool->idle_count]);
+    }
+    if (pool->idle_count == 0 && pool->idle) {
+        TRASHMAP_FREE(pool->idle);
+        pool->idle = NULL;
+        pool->idle_capacity = 0;
+    }
 }
 
-#endif // TRASHMAP_IMPL
\ No newline at end of file
+#endif // TRASHMAP_IMPL